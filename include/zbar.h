@@ -169,11 +169,35 @@ typedef enum zbar_config_e {
     ZBAR_CFG_MAX_LEN,           /**< maximum data length for valid decode */
 
     ZBAR_CFG_UNCERTAINTY = 0x40,/**< required video consistency frames */
+    ZBAR_CFG_STOP_AFTER,        /**< image scanner stops once this many
+                                 * symbols of the symbology are confirmed
+                                 * (0 = never) @since 0.11 */
 
     ZBAR_CFG_POSITION = 0x80,   /**< enable scanner to collect position data */
+    ZBAR_CFG_EDGE_LIST,         /**< image scanner extracts edges of a
+                                 * pass before decoding them, and keeps
+                                 * them for zbar_redecode_image()
+                                 * @since 0.11 */
 
     ZBAR_CFG_X_DENSITY = 0x100, /**< image scanner vertical scan density */
     ZBAR_CFG_Y_DENSITY,         /**< image scanner horizontal scan density */
+    ZBAR_CFG_COARSE_DENSITY,    /**< image scanner coarse pass density
+                                 * (0 = disabled) @since 0.11 */
+    ZBAR_CFG_TRACK_INTERVAL,    /**< image scanner full scan interval
+                                 * for cached symbol tracking
+                                 * (0 = disabled) @since 0.11 */
+    ZBAR_CFG_SKIP_THRESHOLD,    /**< image scanner luma difference below
+                                 * which an image is considered unchanged
+                                 * and not scanned: it gets the previous
+                                 * results, which are not reported again
+                                 * if the result cache is enabled
+                                 * (0 = disabled) @since 0.11 */
+    ZBAR_CFG_SKIP_INTERVAL,     /**< image scanner maximum number of
+                                 * unchanged images skipped in a row
+                                 * (0 = unlimited) @since 0.11 */
+    ZBAR_CFG_MAX_RESULTS,       /**< image scanner stops once this many
+                                 * symbols are confirmed
+                                 * (0 = unlimited) @since 0.11 */
 } zbar_config_t;
 
 /** decoder symbology modifier flags.
@@ -380,8 +404,8 @@ extern int zbar_symbol_get_count(const zbar_symbol_t *symbol);
  * location polygon defines the image area that the symbol was
  * extracted from.
  * @returns the number of points in the location polygon
- * @note this is currently not a polygon, but the scan locations
- * where the symbol was decoded
+ * @note for linear symbols this is a convex octagon (at most 8 points)
+ * containing every scan location where the symbol was decoded
  */
 extern unsigned zbar_symbol_get_loc_size(const zbar_symbol_t *symbol);
 
@@ -474,6 +498,14 @@ extern void zbar_symbol_set_ref(const zbar_symbol_set_t *symbols,
  */
 extern int zbar_symbol_set_get_size(const zbar_symbol_set_t *symbols);
 
+/** check for incomplete results.
+ * @returns non-0 if the scan that produced the set stopped at the
+ * image scanner deadline, 0 otherwise
+ * @see zbar_image_scanner_set_deadline()
+ * @since 0.11
+ */
+extern int zbar_symbol_set_is_truncated(const zbar_symbol_set_t *symbols);
+
 /** set iterator.
  * @returns the first decoded symbol result in a set
  * @returns NULL if the set is empty
@@ -608,6 +640,13 @@ extern void zbar_image_get_crop(const zbar_image_t *image,
                                 unsigned *width,
                                 unsigned *height);
 
+/** retrieve the row stride of the image.
+ * @returns the number of bytes from the start of one row of the first
+ * image plane to the next, or 0 if rows are packed
+ * @since 0.11
+ */
+extern unsigned zbar_image_get_stride(const zbar_image_t *image);
+
 /** return the image sample data.  the returned data buffer is only
  * valid until zbar_image_destroy() is called
  */
@@ -675,6 +714,18 @@ extern void zbar_image_set_crop(zbar_image_t *image,
                                 unsigned width,
                                 unsigned height);
 
+/** specify the row stride (pitch) of the image data, for buffers with
+ * padded rows or sub-rectangles of a larger buffer.  this is the
+ * number of bytes from the start of one row of the first image plane
+ * to the next; chroma planes of planar formats follow the luma plane
+ * with the stride scaled by their subsampling.  use 0 (the default)
+ * for packed rows.  converted images are always packed
+ * @note this does not affect the data!
+ * @since 0.11
+ */
+extern void zbar_image_set_stride(zbar_image_t *image,
+                                  unsigned stride);
+
 /** specify image sample data.  when image data is no longer needed by
  * the library the specific data cleanup handler will be called
  * (unless NULL)
@@ -1174,9 +1225,45 @@ struct zbar_image_scanner_s;
 /** opaque image scanner object. */
 typedef struct zbar_image_scanner_s zbar_image_scanner_t;
 
+/** statistics of the last image scan.
+ * times are in microseconds.  with multiple scan threads, pass times
+ * add up the time spent by every thread
+ * @see zbar_image_scanner_get_stats()
+ * @since 0.11
+ */
+typedef struct zbar_scan_stats_s {
+    unsigned long time_x;       /**< horizontal pass (scanning rows) */
+    unsigned long time_y;       /**< vertical pass (scanning columns) */
+    unsigned long time_qr_locate; /**< QR Code finder center location */
+    unsigned long time_qr_binarize; /**< QR Code image binarization */
+    unsigned long time_qr_decode; /**< QR Code grid sampling and decode */
+    unsigned long time_filter;  /**< linear result filtering (EAN/UPC) */
+    unsigned long edges;        /**< edges located by the linear scanner */
+    unsigned long widths;       /**< widths consumed by each decoder */
+    unsigned decoders;          /**< enabled symbology decoders */
+    unsigned long partials;     /**< partial symbols decoded */
+    unsigned long duplicates;   /**< results merged with an earlier one */
+    unsigned long syms_new;     /**< symbols allocated */
+    unsigned long syms_recycled; /**< symbols reused from the scanner */
+    unsigned long sets_new;     /**< result sets allocated */
+} zbar_scan_stats_t;
+
 /** constructor. */
 extern zbar_image_scanner_t *zbar_image_scanner_create(void);
 
+/** create a new scanner with the same configuration as @p scanner.
+ * symbology, density and scanner settings, the data handler, deadline,
+ * cache and statistics enables and thread count are copied; results,
+ * cached symbols and other scan state are not.  decoding tables are
+ * shared, so cloning is much cheaper than creating and configuring a
+ * scanner, eg, for each thread of a pool.  the clone is independent
+ * and may be used concurrently with @p scanner
+ * @returns the new scanner or NULL on failure
+ * @since 0.11
+ */
+extern zbar_image_scanner_t*
+zbar_image_scanner_clone(const zbar_image_scanner_t *scanner);
+
 /** destructor. */
 extern void zbar_image_scanner_destroy(zbar_image_scanner_t *scanner);
 
@@ -1230,6 +1317,46 @@ zbar_image_scanner_parse_config (zbar_image_scanner_t *scanner,
 extern void zbar_image_scanner_enable_cache(zbar_image_scanner_t *scanner,
                                             int enable);
 
+/** set number of threads used to scan each image (default 1).
+ * scan lines are split into bands that are scanned concurrently, then
+ * merged in scan order.  results match single threaded scanning, except
+ * that partial DataBar and EAN/UPC halves are not paired across bands
+ * @returns 0 for success, non-0 for failure (invalid value or no thread
+ * support)
+ * @since 0.11
+ */
+extern int zbar_image_scanner_set_threads(zbar_image_scanner_t *scanner,
+                                          int nthreads);
+
+/** bound the time spent scanning each image.
+ * once @p usec microseconds have passed, scanning stops at the next
+ * scan line or QR Code candidate.  the symbols found so far are
+ * returned and the result set is flagged as truncated
+ * @param usec time limit (0 for none, the default)
+ * @see zbar_symbol_set_is_truncated()
+ * @since 0.11
+ */
+extern void zbar_image_scanner_set_deadline(zbar_image_scanner_t *scanner,
+                                            unsigned long usec);
+
+/** enable or disable collection of scan statistics (default disabled).
+ * while enabled, each scanned image is timed by stage and counted
+ * @see zbar_image_scanner_get_stats()
+ * @since 0.11
+ */
+extern void zbar_image_scanner_enable_stats(zbar_image_scanner_t *scanner,
+                                            int enable);
+
+/** retrieve statistics of the last scanned image.
+ * every enabled decoder consumes each width, so there are
+ * widths * decoders decoder calls.  symbol allocation counts are
+ * not available if the library was built with NO_STATS
+ * @returns 0 for success, non-0 if statistics are not enabled
+ * @since 0.11
+ */
+extern int zbar_image_scanner_get_stats(const zbar_image_scanner_t *scanner,
+                                        zbar_scan_stats_t *stats);
+
 /** remove any previously decoded results from the image scanner and the
  * specified image.  somewhat more efficient version of
  * zbar_image_set_symbols(image, NULL) which may retain memory for
@@ -1251,15 +1378,29 @@ extern const zbar_symbol_set_t*
 zbar_image_scanner_get_results(const zbar_image_scanner_t *scanner);
 
 /** scan for symbols in provided image.  The image format must be
- * "Y800" or "GRAY".
+ * grayscale ("Y800" or "GREY") or YUV with scannable luma: planar
+ * (eg "I420", "YV12"), "NV12"/"NV21" or packed ("YUYV", "UYVY").
+ * luma is read in place, without conversion
  * @returns >0 if symbols were successfully decoded from the image,
  * 0 if no symbols were found or -1 if an error occurs
  * @see zbar_image_convert()
  * @since 0.9 - changed to only accept grayscale images
+ * @since 0.11 - also accepts YUV images
  */
 extern int zbar_scan_image(zbar_image_scanner_t *scanner,
                            zbar_image_t *image);
 
+/** decode the edges extracted by the last zbar_scan_image() of
+ * @p image again, using the current symbology configuration.
+ * linear symbologies are decoded without reading pixels (QR Code
+ * still reads the image).  requires ::ZBAR_CFG_EDGE_LIST
+ * @returns as zbar_scan_image(), or -1 if no edges were kept or the
+ * image format does not have scannable luma
+ * @since 0.11
+ */
+extern int zbar_redecode_image(zbar_image_scanner_t *scanner,
+                               zbar_image_t *image);
+
 /*@}*/
 
 /*------------------------------------------------------------*/
@@ -1458,6 +1599,18 @@ extern zbar_symbol_type_t zbar_scanner_flush(zbar_scanner_t *scanner);
 extern zbar_symbol_type_t zbar_scan_y(zbar_scanner_t *scanner,
                                       int y);
 
+/** process a line of 8-bit intensity samples.
+ * equivalent to calling zbar_scan_y() for each of the @p n samples
+ * read from @p samples at a (possibly negative) @p stride, but
+ * filters the whole line at once
+ * @returns the highest priority result of the zbar_scan_y() calls
+ * @since 0.11
+ */
+extern zbar_symbol_type_t zbar_scanner_scan_line(zbar_scanner_t *scanner,
+                                                 const unsigned char *samples,
+                                                 int n,
+                                                 int stride);
+
 /** process next sample from RGB (or BGR) triple. */
 static inline zbar_symbol_type_t zbar_scan_rgb24 (zbar_scanner_t *scanner,
                                                     unsigned char *rgb)
@@ -1478,6 +1631,52 @@ extern unsigned zbar_scanner_get_edge(const zbar_scanner_t *scn,
 /** retrieve last scanned color. */
 extern zbar_color_t zbar_scanner_get_color(const zbar_scanner_t *scanner);
 
+/** recorded scan line element.
+ * @see zbar_scanner_record_edges()
+ * @since 0.11
+ */
+typedef struct zbar_edge_s {
+    unsigned pos;               /**< sub-pixel position of the edge ending
+                                 * the element (scanner internal units) */
+    unsigned width : 31;        /**< element width (0 flushes decoder) */
+    unsigned color : 1;         /**< ::zbar_color_t of the element */
+} zbar_edge_t;
+
+/** record located edges instead of passing widths to the decoder.
+ * while enabled, each element is appended to an edge list owned by
+ * the scanner, which may later be decoded (repeatedly) using
+ * zbar_scanner_decode_edges().  zbar_scanner_new_scan() does not
+ * update the decoder, call zbar_decoder_new_scan() between decoded scans
+ * @since 0.11
+ */
+extern void zbar_scanner_record_edges(zbar_scanner_t *scanner,
+                                      int enable);
+
+/** retrieve the recorded edge list.
+ * the list is only valid until more edges are recorded
+ * @returns the edges and their number in @p n
+ * @since 0.11
+ */
+extern const zbar_edge_t *zbar_scanner_get_edges(const zbar_scanner_t *scanner,
+                                                 unsigned *n);
+
+/** discard recorded edges.  the buffer is retained for reuse.
+ * @since 0.11
+ */
+extern void zbar_scanner_clear_edges(zbar_scanner_t *scanner);
+
+/** pass recorded edges to the associated decoder.
+ * decoder callbacks see the scanner width, edge and color of the
+ * recorded element, as if the samples were being scanned.
+ * the scanner state is otherwise unchanged
+ * @returns the highest priority decode result
+ * @since 0.11
+ */
+extern zbar_symbol_type_t
+zbar_scanner_decode_edges(zbar_scanner_t *scanner,
+                          const zbar_edge_t *edges,
+                          unsigned n);
+
 /*@}*/
 
 #ifdef __cplusplus
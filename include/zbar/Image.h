@@ -222,6 +222,22 @@ public:
         zbar_image_set_crop(_img, x, y, width, height);
     }
 
+    /// retrieve the row stride of the image.
+    /// see zbar_image_get_stride()
+    /// @since 0.11
+    unsigned get_stride () const
+    {
+        return(zbar_image_get_stride(_img));
+    }
+
+    /// specify the row stride of the image data.
+    /// see zbar_image_set_stride()
+    /// @since 0.11
+    void set_stride (unsigned stride)
+    {
+        zbar_image_set_stride(_img, stride);
+    }
+
     /// return the image sample data.
     /// see zbar_image_get_data()
     const void *get_data () const
@@ -53,6 +53,16 @@ public:
         zbar_image_scanner_destroy(_scanner);
     }
 
+    /// create a new scanner with the same configuration.
+    /// the caller owns (and must delete) the result
+    /// @see zbar_image_scanner_clone()
+    /// @since 0.11
+    ImageScanner *clone () const
+    {
+        zbar_image_scanner_t *scanner = zbar_image_scanner_clone(_scanner);
+        return((scanner) ? new ImageScanner(scanner) : NULL);
+    }
+
     /// cast to C image_scanner object
     operator zbar_image_scanner_t* () const
     {
@@ -91,6 +101,38 @@ public:
         zbar_image_scanner_enable_cache(_scanner, enable);
     }
 
+    /// set number of threads used to scan each image.
+    /// @see zbar_image_scanner_set_threads()
+    /// @since 0.11
+    int set_threads (int nthreads)
+    {
+        return(zbar_image_scanner_set_threads(_scanner, nthreads));
+    }
+
+    /// bound the time spent scanning each image.
+    /// @see zbar_image_scanner_set_deadline()
+    /// @since 0.11
+    void set_deadline (unsigned long usec)
+    {
+        zbar_image_scanner_set_deadline(_scanner, usec);
+    }
+
+    /// enable or disable collection of scan statistics.
+    /// @see zbar_image_scanner_enable_stats()
+    /// @since 0.11
+    void enable_stats (bool enable = true)
+    {
+        zbar_image_scanner_enable_stats(_scanner, enable);
+    }
+
+    /// retrieve statistics of the last scanned image.
+    /// @see zbar_image_scanner_get_stats()
+    /// @since 0.11
+    int get_stats (zbar_scan_stats_t &stats) const
+    {
+        return(zbar_image_scanner_get_stats(_scanner, &stats));
+    }
+
     /// remove previous results from scanner and image.
     /// @see zbar_image_scanner_recycle_image()
     /// @since 0.10
@@ -113,6 +155,13 @@ public:
         return(zbar_scan_image(_scanner, image));
     }
 
+    /// decode edges kept from the last scan of image again.
+    /// see zbar_redecode_image()
+    int redecode (Image& image)
+    {
+        return(zbar_redecode_image(_scanner, image));
+    }
+
     /// scan for symbols in provided image.
     /// see zbar_scan_image()
     ImageScanner& operator<< (Image& image)
@@ -104,6 +104,17 @@ class Scanner {
         return(*this);
     }
 
+    /// process a line of 8-bit intensity samples.
+    /// see zbar_scanner_scan_line()
+    /// @since 0.11
+    zbar_symbol_type_t scan_line (const unsigned char *samples,
+                                  int n,
+                                  int stride = 1)
+    {
+        _type = zbar_scanner_scan_line(_scanner, samples, n, stride);
+        return(_type);
+    }
+
     /// process next sample from RGB (or BGR) triple.
     /// see zbar_scan_rgb24()
     zbar_symbol_type_t scan_rgb24 (unsigned char *rgb)
@@ -97,6 +97,13 @@ public:
         return((_syms) ? zbar_symbol_set_get_size(_syms) : 0);
     }
 
+    /// check for results of a scan stopped at its deadline.
+    /// see zbar_symbol_set_is_truncated()
+    bool is_truncated () const
+    {
+        return(_syms && zbar_symbol_set_is_truncated(_syms));
+    }
+
     /// create a new SymbolIterator over decoded results.
     SymbolIterator symbol_begin() const;
 
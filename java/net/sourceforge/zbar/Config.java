@@ -45,12 +45,26 @@ public class Config
 
     /** Required video consistency frames. */
     public static final int UNCERTAINTY = 0x40;
+    /** Image scanner stops after this many symbols of a symbology. */
+    public static final int STOP_AFTER = 0x41;
 
     /** Enable scanner to collect position data. */
     public static final int POSITION = 0x80;
+    /** Image scanner keeps edge lists and decodes them separately. */
+    public static final int EDGE_LIST = 0x81;
 
     /** Image scanner vertical scan density. */
     public static final int X_DENSITY = 0x100;
     /** Image scanner horizontal scan density. */
     public static final int Y_DENSITY = 0x101;
+    /** Image scanner coarse pass density (0 = disabled). */
+    public static final int COARSE_DENSITY = 0x102;
+    /** Image scanner tracking full scan interval (0 = disabled). */
+    public static final int TRACK_INTERVAL = 0x103;
+    /** Image scanner unchanged image threshold (0 = disabled). */
+    public static final int SKIP_THRESHOLD = 0x104;
+    /** Image scanner maximum unchanged images skipped (0 = unlimited). */
+    public static final int SKIP_INTERVAL = 0x105;
+    /** Image scanner stops after this many symbols (0 = unlimited). */
+    public static final int MAX_RESULTS = 0x106;
 }
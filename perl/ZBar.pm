@@ -153,12 +153,26 @@ Decoder configuration constants:
 
 =item Config::MAX_LEN
 
+=item Config::STOP_AFTER
+
 =item Config::POSITION
 
+=item Config::EDGE_LIST
+
 =item Config::X_DENSITY
 
 =item Config::Y_DENSITY
 
+=item Config::COARSE_DENSITY
+
+=item Config::TRACK_INTERVAL
+
+=item Config::SKIP_THRESHOLD
+
+=item Config::SKIP_INTERVAL
+
+=item Config::MAX_RESULTS
+
 =back
 
 Symbology modifier constants:
@@ -289,9 +289,16 @@ BOOT:
         CONSTANT(config, CFG_, MIN_LEN, "min-length");
         CONSTANT(config, CFG_, MAX_LEN, "max-length");
         CONSTANT(config, CFG_, UNCERTAINTY, "uncertainty");
+        CONSTANT(config, CFG_, STOP_AFTER, "stop-after");
         CONSTANT(config, CFG_, POSITION, "position");
+        CONSTANT(config, CFG_, EDGE_LIST, "edge-list");
         CONSTANT(config, CFG_, X_DENSITY, "x-density");
         CONSTANT(config, CFG_, Y_DENSITY, "y-density");
+        CONSTANT(config, CFG_, COARSE_DENSITY, "coarse-density");
+        CONSTANT(config, CFG_, TRACK_INTERVAL, "track-interval");
+        CONSTANT(config, CFG_, SKIP_THRESHOLD, "skip-threshold");
+        CONSTANT(config, CFG_, SKIP_INTERVAL, "skip-interval");
+        CONSTANT(config, CFG_, MAX_RESULTS, "max-results");
     }
 
 MODULE = Barcode::ZBar  PACKAGE = Barcode::ZBar::Modifier  PREFIX = zbar_mod_
@@ -72,9 +72,16 @@ static const enumdef config_defs[] = {
     { "MIN_LEN",        ZBAR_CFG_MIN_LEN },
     { "MAX_LEN",        ZBAR_CFG_MAX_LEN },
     { "UNCERTAINTY",    ZBAR_CFG_UNCERTAINTY },
+    { "STOP_AFTER",     ZBAR_CFG_STOP_AFTER },
     { "POSITION",       ZBAR_CFG_POSITION },
+    { "EDGE_LIST",      ZBAR_CFG_EDGE_LIST },
     { "X_DENSITY",      ZBAR_CFG_X_DENSITY },
     { "Y_DENSITY",      ZBAR_CFG_Y_DENSITY },
+    { "COARSE_DENSITY", ZBAR_CFG_COARSE_DENSITY },
+    { "TRACK_INTERVAL", ZBAR_CFG_TRACK_INTERVAL },
+    { "SKIP_THRESHOLD", ZBAR_CFG_SKIP_THRESHOLD },
+    { "SKIP_INTERVAL",  ZBAR_CFG_SKIP_INTERVAL },
+    { "MAX_RESULTS",    ZBAR_CFG_MAX_RESULTS },
     { NULL, }
 };
 
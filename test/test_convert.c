@@ -40,8 +40,66 @@ static uint32_t formats[] = {
 };
 #endif
 
+/* convert a padded copy of random planar/NV data to the same format,
+ * which must repack it exactly (including odd sizes)
+ */
+static int check_unpad (uint32_t fmt,
+                        int nv,
+                        unsigned w,
+                        unsigned h,
+                        unsigned stride)
+{
+    unsigned cw = w >> 1, ch = h >> 1, y, p;
+    unsigned long n = w * h + cw * ch * 2, i;
+    uint8_t *packed = malloc(n), *padded, *src, *dst;
+    zbar_image_t *img, *out;
+    int rc = 0;
+
+    for(i = 0; i < n; i++)
+        packed[i] = rand();
+    padded = calloc(1, stride * (h + ch * 2));
+    src = packed;
+    dst = padded;
+    for(y = 0; y < h; y++, src += w, dst += stride)
+        memcpy(dst, src, w);
+    /* chroma rows: interleaved w/full stride, or each plane w/half */
+    for(p = 0; p < ((nv) ? 1 : 2); p++)
+        for(y = 0; y < ch; y++) {
+            unsigned len = (nv) ? cw * 2 : cw;
+            memcpy(dst, src, len);
+            src += len;
+            dst += (nv) ? stride : stride >> 1;
+        }
+
+    img = zbar_image_create();
+    zbar_image_set_format(img, fmt);
+    zbar_image_set_size(img, w, h);
+    zbar_image_set_stride(img, stride);
+    zbar_image_set_data(img, padded, dst - padded, NULL);
+    out = zbar_image_convert(img, fmt);
+    if(!out || zbar_image_get_data_length(out) != n ||
+       memcmp(zbar_image_get_data(out), packed, n)) {
+        fprintf(stderr, "ERROR: %.4s %ux%u stride %u not repacked\n",
+                (char*)&fmt, w, h, stride);
+        rc = 1;
+    }
+    if(out)
+        zbar_image_destroy(out);
+    zbar_image_destroy(img);
+    free(padded);
+    free(packed);
+    return(rc);
+}
+
 int main (int argc, char *argv[])
 {
+    if(argc > 1 && !strcmp(argv[1], "-c"))
+        return(check_unpad(fourcc('N','V','1','2'), 1, 63, 47, 70) |
+               check_unpad(fourcc('N','V','2','1'), 1, 63, 47, 70) |
+               check_unpad(fourcc('N','V','1','2'), 1, 64, 48, 80) |
+               check_unpad(fourcc('I','4','2','0'), 0, 63, 47, 70) |
+               check_unpad(fourcc('Y','V','1','2'), 0, 64, 48, 80));
+
     zbar_set_verbosity(10);
 
     uint32_t srcfmt = fourcc('I','4','2','0');
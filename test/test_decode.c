@@ -28,6 +28,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <sys/time.h>
 #include <assert.h>
 
 #include <zbar.h>
@@ -42,6 +43,18 @@ int verbosity = 1;
 int rnd_size = 9;  /* NB should be odd */
 int iter = 0;      /* test iteration */
 
+/* widths fed to the decoder, recorded for replay */
+#define MAX_RECORD (1 << 22)
+unsigned *widths = NULL;
+unsigned long nwidths = 0, widths_alloc = 0;
+/* type and data of each decoded symbol */
+typedef struct sym_log_s {
+    int nsyms;
+    char *buf;
+    unsigned long len, alloc;
+} sym_log_t;
+sym_log_t live_log, replay_log;
+
 #define zprintf(level, format, ...) do {                                \
         if(verbosity >= (level)) {                                      \
             fprintf(stderr, format , ##__VA_ARGS__); \
@@ -54,9 +67,34 @@ static inline void print_sep (int level)
             "----------------------------------------------------------\n");
 }
 
+static void log_symbol (sym_log_t *log,
+                        zbar_decoder_t *decoder)
+{
+    zbar_symbol_type_t type = zbar_decoder_get_type(decoder);
+    const char *name = zbar_get_symbol_name(type);
+    unsigned datalen = zbar_decoder_get_data_length(decoder);
+    unsigned long n = strlen(name) + datalen + 2;
+    if(type <= ZBAR_PARTIAL)
+        return;
+    log->nsyms++;
+
+    if(log->len + n > log->alloc) {
+        while(log->len + n > log->alloc)
+            log->alloc = (log->alloc) ? log->alloc * 2 : 4096;
+        log->buf = realloc(log->buf, log->alloc);
+    }
+    memcpy(log->buf + log->len, name, strlen(name));
+    log->len += strlen(name);
+    log->buf[log->len++] = ':';
+    memcpy(log->buf + log->len, zbar_decoder_get_data(decoder), datalen);
+    log->len += datalen;
+    log->buf[log->len++] = '\n';
+}
+
 static void symbol_handler (zbar_decoder_t *decoder)
 {
     zbar_symbol_type_t sym = zbar_decoder_get_type(decoder);
+    log_symbol(&live_log, decoder);
     if(sym <= ZBAR_PARTIAL || sym == ZBAR_QRCODE)
         return;
     const char *data = zbar_decoder_get_data(decoder);
@@ -95,13 +133,24 @@ static void expect (zbar_symbol_type_t sym,
     expect_data = (data) ? strdup(data) : NULL;
 }
 
+static void decode_width (unsigned w)
+{
+    if(nwidths >= widths_alloc && widths_alloc < MAX_RECORD) {
+        widths_alloc = (widths_alloc) ? widths_alloc * 2 : 4096;
+        widths = realloc(widths, widths_alloc * sizeof(*widths));
+    }
+    if(nwidths < widths_alloc)
+        widths[nwidths++] = w;
+    zbar_decode_width(decoder, w);
+}
+
 static void encode_junk (int n)
 {
     if(n > 1)
         zprintf(3, "encode random junk...\n");
     int i;
     for(i = 0; i < n; i++)
-        zbar_decode_width(decoder, 20. * (rand() / (RAND_MAX + 1.)) + 1);
+        decode_width(20. * (rand() / (RAND_MAX + 1.)) + 1);
 }
 
 #define FWD 1
@@ -118,7 +167,7 @@ static void encode (uint64_t units,
 
     while(units) {
         unsigned char w = (fwd) ? units & 0xf : units >> 0x3c;
-        zbar_decode_width(decoder, w);
+        decode_width(w);
         if(fwd)
             units >>= 4;
         else
@@ -1232,6 +1281,71 @@ int test1 ()
     return(0);
 }
 
+static void replay_handler (zbar_decoder_t *decoder)
+{
+    log_symbol(&replay_log, decoder);
+}
+
+static double now_ms ()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return(tv.tv_sec * 1000. + tv.tv_usec / 1000.);
+}
+
+/* feed a recorded width stream to a reset decoder */
+static void replay_widths (const unsigned *w,
+                           unsigned long n)
+{
+    const unsigned *end = w + n;
+    zbar_decoder_reset(decoder);
+    replay_log.nsyms = 0;
+    replay_log.len = 0;
+    for(; w < end; w++)
+        zbar_decode_width(decoder, *w);
+}
+
+/* replay the recorded widths; results must match those decoded live.
+ * -b also reports replay speed
+ */
+static int test_replay (int bench)
+{
+    int r, rc = 0, reps = (bench) ? 20 : 1;
+    double t0, t1;
+
+    if(nwidths >= MAX_RECORD) {
+        zprintf(1, "replay skipped (more than %d widths)\n", MAX_RECORD);
+        return(0);
+    }
+
+    zbar_decoder_set_handler(decoder, replay_handler);
+    t0 = now_ms();
+    for(r = 0; r < reps; r++)
+        replay_widths(widths, nwidths);
+    t1 = now_ms();
+
+    if(!live_log.nsyms || replay_log.nsyms != live_log.nsyms) {
+        zprintf(0, "replay mismatch: %d symbols live, %d replayed\n",
+                live_log.nsyms, replay_log.nsyms);
+        rc = 1;
+    }
+    else if(replay_log.len != live_log.len ||
+            memcmp(replay_log.buf, live_log.buf, live_log.len)) {
+        zprintf(0, "replayed results differ from live decode\n");
+        rc = 1;
+    }
+    else
+        zprintf(1, "replay matches (%lu widths, %d symbols)\n",
+                nwidths, replay_log.nsyms);
+    if(!rc && bench)
+        zprintf(0, "%lu widths: replay %.2fms\n",
+                nwidths, (t1 - t0) / reps);
+
+    free(live_log.buf);
+    free(replay_log.buf);
+    return(rc);
+}
+
 /* FIXME TBD:
  *   - random module width (!= 1.0)
  *   - simulate scan speed variance
@@ -1241,7 +1355,7 @@ int test1 ()
 
 int main (int argc, char **argv)
 {
-    int n, i, j;
+    int n, i, j, do_bench = 0, rc;
     char *end;
 
     decoder = zbar_decoder_create();
@@ -1264,6 +1378,7 @@ int main (int argc, char **argv)
             {
             case 'q': verbosity = 0; break;
             case 'v': verbosity++; break;
+            case 'b': do_bench = 1; break;
             case 'r':
                 seed = time(NULL);
                 srand(seed);
@@ -1318,6 +1433,9 @@ int main (int argc, char **argv)
 
     /* FIXME "Ran %d iterations in %gs\n\nOK\n" */
 
+    rc = test_replay(do_bench);
+
     zbar_decoder_destroy(decoder);
-    return(0);
+    free(widths);
+    return(rc);
 }
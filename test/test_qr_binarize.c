@@ -0,0 +1,208 @@
+/*------------------------------------------------------------------------
+ *  Copyright 2007-2010 (c) Jeff Brown <spadix@users.sourceforge.net>
+ *
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* compare the QR binarizer (vectorized where available) against the
+ * scalar reference.  masks must be byte-identical; -b also reports speed
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "qrcode/binarize.h"
+
+#define IMG_MAX_DIM 1200
+
+unsigned seed = 0;
+int verbosity = 1;
+int iter = 0;
+
+#define zprintf(level, format, ...) do {                                \
+        if(verbosity >= (level)) {                                      \
+            fprintf(stderr, format , ##__VA_ARGS__);                    \
+        }                                                               \
+    } while(0)
+
+/* random noise, gradients and bars (including full 0..255 range) */
+static void gen_image (unsigned char *img,
+                       int w,
+                       int h)
+{
+    int x, y, kind = rand() % 3;
+    int noise = 1 + rand() % 64;
+    int period = 1 + rand() % 32;
+    for(y = 0; y < h; y++)
+        for(x = 0; x < w; x++) {
+            int v;
+            if(kind == 0)
+                v = rand() & 0xff;
+            else if(kind == 1)
+                v = (x * 255 / w + y * 255 / h) / 2 + rand() % noise;
+            else
+                v = (((x + y / 4) / period) & 1) ? 230 : 20;
+            img[y * w + x] = (v > 255) ? 255 : v;
+        }
+}
+
+static int test1 ()
+{
+    int w, h, stride, i, rc = 0;
+    unsigned char *img, *ref, *mask, *padded;
+
+    srand(seed);
+    zprintf(2, "test %d: SEED=%d\n", iter, seed);
+    iter++;
+    w = 1 + rand() % IMG_MAX_DIM;
+    h = 1 + rand() % IMG_MAX_DIM;
+    if(rand() & 1) {
+        /* small images exercise the edge clamping */
+        w = 1 + w % 96;
+        h = 1 + h % 96;
+    }
+    img = malloc(w * h);
+    ref = malloc(w * h);
+    gen_image(img, w, h);
+
+    /* same image w/padded rows (padding must be ignored) */
+    stride = w + rand() % 64;
+    padded = malloc(stride * h);
+    memset(padded, 0xff, stride * h);
+    for(i = 0; i < h; i++)
+        memcpy(padded + i * stride, img + i * w, w);
+
+    qr_binarize_rect_c(ref, img, w, h, w, 0, 0, w, h);
+    mask = qr_binarize(img, w, h);
+    if(memcmp(ref, mask, w * h)) {
+        zprintf(0, "full image mismatch (%dx%d)\n", w, h);
+        rc = 1;
+    }
+
+    /* sub-rectangles must match the full image mask */
+    for(i = 0; !rc && i < 4; i++) {
+        int x0 = rand() % w, x1 = x0 + 1 + rand() % (w - x0);
+        int y0 = rand() % h, y1 = y0 + 1 + rand() % (h - y0);
+        int y;
+        memset(mask, 0x55, w * h);
+        if(i & 1)
+            qr_binarize_rect(mask, padded, w, h, stride, x0, y0, x1, y1, NULL);
+        else
+            qr_binarize_rect(mask, img, w, h, w, x0, y0, x1, y1, NULL);
+        for(y = y0; !rc && y < y1; y++)
+            if(memcmp(ref + y * w + x0, mask + y * w + x0, x1 - x0)) {
+                zprintf(0, "rect [%d,%d)x[%d,%d) mismatch (%dx%d stride=%d)\n",
+                        x0, x1, y0, y1, w, h, (i & 1) ? stride : w);
+                rc = 1;
+            }
+    }
+    if(rc)
+        zprintf(0, "SEED=%d\n", seed);
+
+    free(mask);
+    free(padded);
+    free(ref);
+    free(img);
+    return(rc);
+}
+
+static double now_ms ()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return(tv.tv_sec * 1000. + tv.tv_usec / 1000.);
+}
+
+/* time both implementations over a 1080p frame */
+static void bench ()
+{
+    int r, w = 1920, h = 1080;
+    unsigned char *img = malloc(w * h), *mask = malloc(w * h);
+    double t0, t1, t2;
+    gen_image(img, w, h);
+
+    t0 = now_ms();
+    for(r = 0; r < 10; r++)
+        qr_binarize_rect_c(mask, img, w, h, w, 0, 0, w, h);
+    t1 = now_ms();
+    for(r = 0; r < 10; r++)
+        qr_binarize_rect(mask, img, w, h, w, 0, 0, w, h, NULL);
+    t2 = now_ms();
+
+    zprintf(0, "1080p frame: reference %.2fms, qr_binarize_rect %.2fms\n",
+            (t1 - t0) / 10, (t2 - t1) / 10);
+    free(mask);
+    free(img);
+}
+
+int main (int argc, char **argv)
+{
+    int n = 64, i, j, rc = 0, do_bench = 0;
+    char *end;
+
+    for(i = 1; i < argc; i++) {
+        if(argv[i][0] != '-') {
+            fprintf(stderr, "ERROR: unknown argument: %s\n", argv[i]);
+            return(2);
+        }
+        for(j = 1; argv[i][j]; j++) {
+            switch(argv[i][j])
+            {
+            case 'q': verbosity = 0; break;
+            case 'v': verbosity++; break;
+            case 'b': do_bench = 1; break;
+            case 'r':
+                seed = time(NULL);
+                zprintf(0, "-r SEED=%d\n", seed);
+                break;
+
+            case 'n':
+                if(!argv[i][++j] && !(j = 0) && ++i >= argc) {
+                    fprintf(stderr, "ERROR: -n needs <num> argument\n");
+                    return(2);
+                }
+                n = strtol(argv[i] + j, &end, 0);
+                if(!isdigit(argv[i][j]) || !n) {
+                    fprintf(stderr, "ERROR: invalid <num>: \"%s\"\n",
+                            argv[i] + j);
+                    return(2);
+                }
+                j = end - argv[i] - 1;
+                break;
+            }
+        }
+    }
+
+    while(!rc && n--) {
+        rc = test1();
+        seed = (rand() << 8) ^ rand();
+    }
+    if(!rc)
+        zprintf(1, "qr_binarize matches reference (%d tests)\n", iter);
+
+    if(!rc && do_bench)
+        bench();
+
+    return(rc);
+}
@@ -0,0 +1,201 @@
+/*------------------------------------------------------------------------
+ *  Copyright 2007-2010 (c) Jeff Brown <spadix@users.sourceforge.net>
+ *
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* scan a cluttered scene: a pallet of labels, each w/a QR Code and stray
+ * finder-like marks, among scattered finder patterns.  every code must be
+ * found before the QR reader gives up on the candidate finder triples
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <zbar.h>
+
+#define WIDTH  1600
+#define HEIGHT 900
+
+/* labels on a grid of cells */
+#define LABELS_X 4
+#define LABELS_Y 2
+#define CELL_W   (WIDTH / LABELS_X)
+#define CELL_H   (HEIGHT / LABELS_Y)
+
+#define NCLUTTER 160
+
+int verbosity = 1;
+
+#define zprintf(level, format, ...) do {                                \
+        if(verbosity >= (level)) {                                      \
+            fprintf(stderr, format , ##__VA_ARGS__);                    \
+        }                                                               \
+    } while(0)
+
+/* version 1-M QR Code encoding "zbar" */
+static const char *const qr_zbar[] = {
+    "111111101101001111111",
+    "100000101101001000001",
+    "101110100011101011101",
+    "101110101001101011101",
+    "101110100110001011101",
+    "100000100100001000001",
+    "111111101010101111111",
+    "000000001000000000000",
+    "101101110000001001011",
+    "101100001010100100101",
+    "100110101010111111111",
+    "011001001110110001011",
+    "111011111011010010001",
+    "000000001110010101010",
+    "111111101000011011000",
+    "100000101011111001100",
+    "101110100111001000111",
+    "101110101100010010010",
+    "101110101001010010000",
+    "100000100101101011001",
+    "111111101101100100000",
+};
+
+static const char *const finder[] = {
+    "1111111",
+    "1000001",
+    "1011101",
+    "1011101",
+    "1011101",
+    "1000001",
+    "1111111",
+};
+
+/* deterministic scene independent of the C library rand() */
+static unsigned long lcg = 1;
+static unsigned next_rand (unsigned n)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return((lcg >> 16) % n);
+}
+
+static void fill (unsigned char *img,
+                  int x,
+                  int y,
+                  int w,
+                  int h,
+                  unsigned char v)
+{
+    int i, j;
+    for(j = y; j < y + h; j++)
+        for(i = x; i < x + w; i++)
+            if(i >= 0 && i < WIDTH && j >= 0 && j < HEIGHT)
+                img[j * WIDTH + i] = v;
+}
+
+/* draw dark modules of a pattern w/module size m */
+static void draw (unsigned char *img,
+                  const char *const *rows,
+                  int n,
+                  int x,
+                  int y,
+                  int m)
+{
+    int r, c;
+    for(r = 0; r < n; r++)
+        for(c = 0; c < n; c++)
+            if(rows[r][c] == '1')
+                fill(img, x + c * m, y + r * m, m, m, 25);
+}
+
+static int in_label (int x,
+                     int y)
+{
+    /* codes (w/quiet zone) and label marks occupy the top left of a cell */
+    return(x % CELL_W < 260 && y % CELL_H < 260);
+}
+
+int main (int argc, char **argv)
+{
+    unsigned char *img = malloc(WIDTH * HEIGHT);
+    zbar_image_scanner_t *scanner;
+    zbar_image_t *image;
+    const zbar_symbol_t *sym;
+    int i, n, nfound = 0, rc = 0;
+
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-q"))
+            verbosity = 0;
+        else if(!strcmp(argv[i], "-v"))
+            verbosity++;
+        else {
+            fprintf(stderr, "ERROR: unknown argument: %s\n", argv[i]);
+            return(2);
+        }
+    }
+
+    memset(img, 235, WIDTH * HEIGHT);
+    /* scattered finder patterns of similar sizes */
+    for(n = 0; n < NCLUTTER; ) {
+        int x = next_rand(WIDTH - 40), y = next_rand(HEIGHT - 40);
+        if(in_label(x, y) || in_label(x + 40, y + 40) ||
+           in_label(x + 40, y) || in_label(x, y + 40))
+            continue;
+        draw(img, finder, 7, x, y, 3 + next_rand(3));
+        n++;
+    }
+    /* labels: a code plus two finder-like logo marks */
+    for(i = 0; i < LABELS_X * LABELS_Y; i++) {
+        int x = (i % LABELS_X) * CELL_W + 20;
+        int y = (i / LABELS_X) * CELL_H + 20;
+        draw(img, qr_zbar, 21, x, y, 5);
+        draw(img, finder, 7, x + 10, y + 150, 5);
+        draw(img, finder, 7, x + 160, y + 160, 4);
+    }
+
+    scanner = zbar_image_scanner_create();
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_ENABLE, 0);
+    zbar_image_scanner_set_config(scanner, ZBAR_QRCODE, ZBAR_CFG_ENABLE, 1);
+    image = zbar_image_create();
+    zbar_image_set_format(image, zbar_fourcc('Y','8','0','0'));
+    zbar_image_set_size(image, WIDTH, HEIGHT);
+    zbar_image_set_data(image, img, WIDTH * HEIGHT, NULL);
+
+    n = zbar_scan_image(scanner, image);
+    for(sym = zbar_image_first_symbol(image); sym;
+        sym = zbar_symbol_next(sym)) {
+        zprintf(2, "    %s: %s\n",
+                zbar_get_symbol_name(zbar_symbol_get_type(sym)),
+                zbar_symbol_get_data(sym));
+        if(zbar_symbol_get_type(sym) == ZBAR_QRCODE &&
+           !strcmp(zbar_symbol_get_data(sym), "zbar"))
+            nfound++;
+    }
+    if(n < 0 || nfound != LABELS_X * LABELS_Y) {
+        zprintf(0, "ERROR: found %d of %d QR Codes in cluttered scene\n",
+                nfound, LABELS_X * LABELS_Y);
+        rc = 1;
+    }
+    else
+        zprintf(1, "found all %d QR Codes in cluttered scene\n", nfound);
+
+    zbar_image_destroy(image);
+    zbar_image_scanner_destroy(scanner);
+    free(img);
+    return(rc);
+}
@@ -0,0 +1,341 @@
+/*------------------------------------------------------------------------
+ *  Copyright 2007-2010 (c) Jeff Brown <spadix@users.sourceforge.net>
+ *
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* compare zbar_scanner_scan_line() against per-sample zbar_scan_y(),
+ * and decoding recorded edges against decoding while scanning.
+ * results must be bit-identical; -b also reports relative speed
+ */
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <zbar.h>
+
+#define LINE_MAX_LEN 4096
+#define LOG_MAX 8192
+
+/* undocumented debug API (see dbg_scan) */
+extern void zbar_scanner_get_state(const zbar_scanner_t *scn,
+                                   unsigned *x,
+                                   unsigned *cur_edge,
+                                   unsigned *last_edge,
+                                   int *y0,
+                                   int *y1,
+                                   int *y2,
+                                   int *y1_thresh);
+
+typedef struct scan_log_s {
+    zbar_decoder_t *dcode;
+    zbar_scanner_t *scn;
+    int n;
+    unsigned ev[LOG_MAX][4];
+} scan_log_t;
+
+unsigned seed = 0;
+int verbosity = 1;
+int iter = 0;
+
+#define zprintf(level, format, ...) do {                                \
+        if(verbosity >= (level)) {                                      \
+            fprintf(stderr, format , ##__VA_ARGS__);                    \
+        }                                                               \
+    } while(0)
+
+static void log_handler (zbar_decoder_t *dcode)
+{
+    scan_log_t *log = zbar_decoder_get_userdata(dcode);
+    const char *data = zbar_decoder_get_data(dcode);
+    unsigned i, hash = 0, len = zbar_decoder_get_data_length(dcode);
+    zbar_symbol_type_t type = zbar_decoder_get_type(dcode);
+    if(type > ZBAR_PARTIAL)
+        for(i = 0; i < len; i++)
+            hash = hash * 31 + (unsigned char)data[i];
+    if(log->n < LOG_MAX) {
+        unsigned *ev = log->ev[log->n++];
+        ev[0] = type;
+        ev[1] = hash;
+        ev[2] = zbar_scanner_get_edge(log->scn, 0, 5);
+        ev[3] = zbar_scanner_get_width(log->scn);
+    }
+}
+
+static zbar_scanner_t *create_scanner (scan_log_t *log)
+{
+    zbar_decoder_t *dcode = log->dcode = zbar_decoder_create();
+    zbar_decoder_set_config(dcode, 0, ZBAR_CFG_ENABLE, 1);
+    zbar_decoder_set_userdata(dcode, log);
+    zbar_decoder_set_handler(dcode, log_handler);
+    log->n = 0;
+    log->scn = zbar_scanner_create(dcode);
+    return(log->scn);
+}
+
+static void destroy_scanner (scan_log_t *log)
+{
+    /* NB scanner does not own decoder */
+    zbar_scanner_destroy(log->scn);
+    zbar_decoder_destroy(log->dcode);
+}
+
+/* random bars w/noise and blur (or plain noise) */
+static int gen_line (unsigned char *line)
+{
+    int n = 16 + rand() % (LINE_MAX_LEN - 16);
+    int i = 0, color = 0, noise = 1 + rand() % 24;
+    int lo = rand() % 96, hi = 160 + rand() % 96;
+    int flat = !(rand() % 8);
+    int prev = 0;
+    while(i < n) {
+        int w = 1 + rand() % (2 + rand() % 12);
+        int v = (color) ? lo : hi;
+        for(; w-- && i < n; i++) {
+            int y = (flat ? (lo + hi) / 2 : v) + rand() % noise - noise / 2;
+            if(i)
+                y = (y * 3 + prev) / 4;
+            prev = y = (y < 0) ? 0 : (y > 255) ? 255 : y;
+            line[i] = y;
+        }
+        color = !color;
+    }
+    return(n);
+}
+
+static int check_state (zbar_scanner_t *a,
+                        zbar_scanner_t *b)
+{
+    unsigned ax, acur, alast, bx, bcur, blast;
+    int ay0, ay1, ay2, athr, by0, by1, by2, bthr;
+    zbar_scanner_get_state(a, &ax, &acur, &alast, &ay0, &ay1, &ay2, &athr);
+    zbar_scanner_get_state(b, &bx, &bcur, &blast, &by0, &by1, &by2, &bthr);
+    if(ax != bx || acur != bcur || alast != blast || ay0 != by0 ||
+       ay1 != by1 || ay2 != by2 || athr != bthr ||
+       zbar_scanner_get_width(a) != zbar_scanner_get_width(b) ||
+       zbar_scanner_get_color(a) != zbar_scanner_get_color(b)) {
+        zprintf(0, "state mismatch: x=%u/%u edge=%u,%u/%u,%u"
+                " y=%d,%d,%d/%d,%d,%d thr=%d/%d\n",
+                ax, bx, acur, alast, bcur, blast,
+                ay0, ay1, ay2, by0, by1, by2, athr, bthr);
+        return(1);
+    }
+    return(0);
+}
+
+static int test1 ()
+{
+    static unsigned char line[LINE_MAX_LEN], buf[LINE_MAX_LEN * 4];
+    scan_log_t *la = calloc(1, sizeof(scan_log_t));
+    scan_log_t *lb = calloc(1, sizeof(scan_log_t));
+    scan_log_t *lc = calloc(1, sizeof(scan_log_t));
+    zbar_scanner_t *a = create_scanner(la);
+    zbar_scanner_t *b = create_scanner(lb);
+    zbar_scanner_t *c = create_scanner(lc);
+    const zbar_edge_t *edges;
+    unsigned nedges;
+    int pass, nlines, rc = 0;
+
+    zbar_scanner_record_edges(c, 1);
+
+    srand(seed);
+    zprintf(2, "test %d: SEED=%d\n", iter, seed);
+    iter++;
+    nlines = 1 + rand() % 4;
+
+    for(pass = 0; !rc && pass < nlines; pass++) {
+        int i, n = gen_line(line);
+        int stride = 1 + rand() % 4;
+        unsigned char *p = buf;
+        if(rand() & 1) {
+            /* scan backward through buffer */
+            p = buf + (n - 1) * stride;
+            stride = -stride;
+        }
+        for(i = 0; i < n; i++)
+            p[i * stride] = line[i];
+
+        for(i = 0; !rc && i < n; ) {
+            zbar_symbol_type_t ea = ZBAR_NONE, eb;
+            int j, m = 1 + rand() % ((rand() & 1) ? 8 : 1024);
+            if(m > n - i)
+                m = n - i;
+            for(j = 0; j < m; j++) {
+                zbar_symbol_type_t tmp = zbar_scan_y(a, line[i + j]);
+                if(tmp < 0 || tmp > ea)
+                    ea = tmp;
+            }
+            eb = zbar_scanner_scan_line(b, p + i * stride, m, stride);
+            zbar_scanner_scan_line(c, p + i * stride, m, stride);
+            i += m;
+            if(ea != eb) {
+                zprintf(0, "result mismatch @%d: %d != %d\n", i, ea, eb);
+                rc = 1;
+            }
+            else
+                rc = check_state(a, b);
+        }
+
+        /* line boundary, sometimes w/o flushing */
+        if(rand() % 4) {
+            zbar_scanner_flush(a);
+            zbar_scanner_flush(b);
+            zbar_scanner_flush(c);
+            zbar_scanner_flush(a);
+            zbar_scanner_flush(b);
+            zbar_scanner_flush(c);
+            zbar_scanner_new_scan(a);
+            zbar_scanner_new_scan(b);
+            zbar_scanner_new_scan(c);
+
+            /* decode recorded scan */
+            edges = zbar_scanner_get_edges(c, &nedges);
+            zbar_scanner_decode_edges(c, edges, nedges);
+            zbar_scanner_clear_edges(c);
+            zbar_decoder_new_scan(lc->dcode);
+        }
+        else if(rand() & 1) {
+            zbar_scanner_flush(a);
+            zbar_scanner_flush(b);
+            zbar_scanner_flush(c);
+        }
+    }
+    edges = zbar_scanner_get_edges(c, &nedges);
+    zbar_scanner_decode_edges(c, edges, nedges);
+
+    if(!rc && (la->n != lb->n || memcmp(la->ev, lb->ev, la->n * sizeof(la->ev[0])))) {
+        zprintf(0, "decode events mismatch: %d != %d\n", la->n, lb->n);
+        rc = 1;
+    }
+    if(!rc && (la->n != lc->n || memcmp(la->ev, lc->ev, la->n * sizeof(la->ev[0])))) {
+        zprintf(0, "recorded edge events mismatch: %d != %d\n", la->n, lc->n);
+        rc = 1;
+    }
+    if(rc)
+        zprintf(0, "SEED=%d\n", seed);
+
+    destroy_scanner(la);
+    destroy_scanner(lb);
+    destroy_scanner(lc);
+    free(la);
+    free(lb);
+    free(lc);
+    return(rc);
+}
+
+static double now_ms ()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return(tv.tv_sec * 1000. + tv.tv_usec / 1000.);
+}
+
+/* time both entry points over a 1080p frame worth of rows */
+static void bench (zbar_decoder_t *dcode)
+{
+    static unsigned char frame[1080][1920];
+    zbar_scanner_t *scn = zbar_scanner_create(dcode);
+    int i, j, r;
+    double t0, t1, t2;
+
+    for(i = 0; i < 1080; i++)
+        gen_line(frame[i]);
+
+    t0 = now_ms();
+    for(r = 0; r < 10; r++)
+        for(i = 0; i < 1080; i++) {
+            for(j = 0; j < 1920; j++)
+                zbar_scan_y(scn, frame[i][j]);
+            zbar_scanner_new_scan(scn);
+        }
+    t1 = now_ms();
+    for(r = 0; r < 10; r++)
+        for(i = 0; i < 1080; i++) {
+            zbar_scanner_scan_line(scn, frame[i], 1920, 1);
+            zbar_scanner_new_scan(scn);
+        }
+    t2 = now_ms();
+
+    zprintf(0, "1080p frame (%s decoder): zbar_scan_y %.2fms,"
+            " zbar_scanner_scan_line %.2fms\n", (dcode) ? "with" : "no",
+            (t1 - t0) / 10, (t2 - t1) / 10);
+    zbar_scanner_destroy(scn);
+}
+
+int main (int argc, char **argv)
+{
+    int n = 64, i, j, rc = 0, do_bench = 0;
+    char *end;
+
+    for(i = 1; i < argc; i++) {
+        if(argv[i][0] != '-') {
+            fprintf(stderr, "ERROR: unknown argument: %s\n", argv[i]);
+            return(2);
+        }
+        for(j = 1; argv[i][j]; j++) {
+            switch(argv[i][j])
+            {
+            case 'q': verbosity = 0; break;
+            case 'v': verbosity++; break;
+            case 'b': do_bench = 1; break;
+            case 'r':
+                seed = time(NULL);
+                zprintf(0, "-r SEED=%d\n", seed);
+                break;
+
+            case 'n':
+                if(!argv[i][++j] && !(j = 0) && ++i >= argc) {
+                    fprintf(stderr, "ERROR: -n needs <num> argument\n");
+                    return(2);
+                }
+                n = strtol(argv[i] + j, &end, 0);
+                if(!isdigit(argv[i][j]) || !n) {
+                    fprintf(stderr, "ERROR: invalid <num>: \"%s\"\n",
+                            argv[i] + j);
+                    return(2);
+                }
+                j = end - argv[i] - 1;
+                break;
+            }
+        }
+    }
+
+    while(!rc && n--) {
+        rc = test1();
+        seed = (rand() << 8) ^ rand();
+    }
+    if(!rc)
+        zprintf(1, "scan_line matches scan_y (%d tests)\n", iter);
+
+    if(!rc && do_bench) {
+        zbar_decoder_t *dcode = zbar_decoder_create();
+        bench(NULL);
+        bench(dcode);
+        zbar_decoder_destroy(dcode);
+    }
+
+    return(rc);
+}
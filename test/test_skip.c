@@ -0,0 +1,120 @@
+/*------------------------------------------------------------------------
+ *  Copyright 2007-2010 (c) Jeff Brown <spadix@users.sourceforge.net>
+ *
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* skip unchanged images of a slow (fixed mount) video stream w/the
+ * result cache enabled: a symbol that stays in view must be reported
+ * once, even when a run of skipped images outlasts the cache timeout
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zbar.h>
+#include "test_images.h"
+
+/* ms before each image.  the run from the first image to the forced
+ * rescan spans longer than the 4s cache timeout
+ */
+static const unsigned frame_ms[] = { 0, 3000, 1500 };
+#define NFRAMES (sizeof(frame_ms) / sizeof(*frame_ms))
+
+int verbosity = 1;
+int nreported = 0;
+
+#define zprintf(level, format, ...) do {                                \
+        if(verbosity >= (level)) {                                      \
+            fprintf(stderr, format , ##__VA_ARGS__);                    \
+        }                                                               \
+    } while(0)
+
+static void data_handler (zbar_image_t *img,
+                          const void *userdata)
+{
+    const zbar_symbol_t *sym;
+    for(sym = zbar_image_first_symbol(img); sym; sym = zbar_symbol_next(sym))
+        if(!zbar_symbol_get_count(sym)) {
+            zprintf(2, "    reported %s: %s\n",
+                    zbar_get_symbol_name(zbar_symbol_get_type(sym)),
+                    zbar_symbol_get_data(sym));
+            nreported++;
+        }
+}
+
+int main (int argc, char **argv)
+{
+    zbar_image_scanner_t *scanner;
+    zbar_image_t *image;
+    unsigned i;
+    int n, rc = 0;
+
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-q"))
+            verbosity = 0;
+        else if(!strcmp(argv[i], "-v"))
+            verbosity++;
+        else {
+            fprintf(stderr, "ERROR: unknown argument: %s\n", argv[i]);
+            return(2);
+        }
+    }
+
+    scanner = zbar_image_scanner_create();
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_ENABLE, 0);
+    zbar_image_scanner_set_config(scanner, ZBAR_EAN13, ZBAR_CFG_ENABLE, 1);
+    zbar_image_scanner_set_config(scanner, ZBAR_EAN13,
+                                  ZBAR_CFG_UNCERTAINTY, 0);
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_SKIP_THRESHOLD, 8);
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_SKIP_INTERVAL,
+                                  NFRAMES - 1);
+    zbar_image_scanner_enable_cache(scanner, 1);
+    zbar_image_scanner_set_data_handler(scanner, data_handler, NULL);
+
+    image = zbar_image_create();
+    zbar_image_set_format(image, zbar_fourcc('Y','8','0','0'));
+    if(test_image_ean13(image))
+        return(2);
+
+    for(i = 0; i < NFRAMES; i++) {
+        usleep(frame_ms[i] * 1000);
+        n = zbar_scan_image(scanner, image);
+        zprintf(1, "image %u +%ums: %d new symbols\n", i, frame_ms[i], n);
+        if(n < 0 || !zbar_image_first_symbol(image)) {
+            zprintf(0, "ERROR: no results for image %u\n", i);
+            rc = 1;
+        }
+    }
+
+    if(nreported != 1) {
+        zprintf(0, "ERROR: symbol in view reported %d times (expected 1)\n",
+                nreported);
+        rc = 1;
+    }
+
+    zbar_image_destroy(image);
+    zbar_image_scanner_destroy(scanner);
+    if(test_image_check_cleanup())
+        rc = 1;
+    return(rc);
+}
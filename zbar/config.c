@@ -131,6 +131,8 @@ int zbar_parse_config (const char *cfgstr,
         *cfg = ZBAR_CFG_ENABLE;
     else if(len < 3)
         return(1);
+    else if(!strncmp(cfgstr, "coarse-density", len))
+        *cfg = ZBAR_CFG_COARSE_DENSITY;
     else if(!strncmp(cfgstr, "disable", len)) {
         *cfg = ZBAR_CFG_ENABLE;
         negate = !negate; /* no-disable ?!? */
@@ -147,8 +149,20 @@ int zbar_parse_config (const char *cfgstr,
         *cfg = ZBAR_CFG_EMIT_CHECK;
     else if(!strncmp(cfgstr, "uncertainty", len))
         *cfg = ZBAR_CFG_UNCERTAINTY;
+    else if(!strncmp(cfgstr, "stop-after", len))
+        *cfg = ZBAR_CFG_STOP_AFTER;
     else if(!strncmp(cfgstr, "position", len))
         *cfg = ZBAR_CFG_POSITION;
+    else if(!strncmp(cfgstr, "edge-list", len))
+        *cfg = ZBAR_CFG_EDGE_LIST;
+    else if(!strncmp(cfgstr, "track-interval", len))
+        *cfg = ZBAR_CFG_TRACK_INTERVAL;
+    else if(!strncmp(cfgstr, "skip-threshold", len))
+        *cfg = ZBAR_CFG_SKIP_THRESHOLD;
+    else if(!strncmp(cfgstr, "skip-interval", len))
+        *cfg = ZBAR_CFG_SKIP_INTERVAL;
+    else if(!strncmp(cfgstr, "max-results", len))
+        *cfg = ZBAR_CFG_MAX_RESULTS;
     else 
         return(1);
 
@@ -256,6 +256,19 @@ static inline unsigned long uvp_size (const zbar_image_t *img,
            (img->height >> fmt->p.yuv.ysub2));
 }
 
+/* bytes from one row of the first image plane to the next */
+static inline unsigned long row_stride (const zbar_image_t *img,
+                                        const zbar_format_def_t *fmt)
+{
+    if(img->stride)
+        return(img->stride);
+    if(fmt->group == ZBAR_FMT_YUV_PACKED)
+        return(((img->width + 1) & ~1) * 2);
+    if(fmt->group == ZBAR_FMT_RGB_PACKED)
+        return(img->width * fmt->p.rgb.bpp);
+    return(img->width);
+}
+
 static inline uint32_t convert_read_rgb (const uint8_t *srcp,
                                          int bpp)
 {
@@ -309,8 +322,10 @@ static inline void convert_y_resize (zbar_image_t *dst,
 {
     uint8_t *psrc, *pdst;
     unsigned width, height, xpad, y;
+    unsigned long stride = row_stride(src, srcfmt);
 
-    if(dst->width == src->width && dst->height == src->height) {
+    if(dst->width == src->width && dst->height == src->height &&
+       stride == src->width) {
         memcpy((void*)dst->data, src->data, n);
         return;
     }
@@ -322,23 +337,72 @@ static inline void convert_y_resize (zbar_image_t *dst,
     for(y = 0; y < height; y++) {
         memcpy(pdst, psrc, width);
         pdst += width;
-        psrc += src->width;
         if(xpad) {
-            memset(pdst, *(psrc - 1), xpad);
+            memset(pdst, psrc[width - 1], xpad);
             pdst += xpad;
         }
+        psrc += stride;
     }
-    psrc -= src->width;
+    psrc -= stride;
     for(; y < dst->height; y++) {
         memcpy(pdst, psrc, width);
         pdst += width;
         if(xpad) {
-            memset(pdst, *(psrc - 1), xpad);
+            memset(pdst, psrc[width - 1], xpad);
             pdst += xpad;
         }
     }
 }
 
+/* copy each plane of a padded image into packed rows */
+static void convert_unpad (zbar_image_t *dst,
+                           const zbar_image_t *src,
+                           const zbar_format_def_t *fmt)
+{
+    zbar_image_t packed;
+    unsigned long srcl, dstl, rowlen, srcn = 0, dstn = 0;
+    unsigned nrows, p, nplanes = 1, y;
+
+    packed = *src;
+    packed.stride = 0;
+    srcl = row_stride(src, fmt);
+    dstl = row_stride(&packed, fmt);
+    rowlen = dstl;
+    nrows = src->height;
+    dst->datalen = dstl * src->height;
+    if(fmt->group == ZBAR_FMT_YUV_PLANAR) {
+        dst->datalen += uvp_size(src, fmt) * 2;
+        nplanes = 3;
+    }
+    else if(fmt->group == ZBAR_FMT_YUV_NV) {
+        dst->datalen += uvp_size(src, fmt) * 2;
+        nplanes = 2;
+    }
+    dst->data = malloc(dst->datalen);
+    if(!dst->data) return;
+
+    for(p = 0; p < nplanes; p++) {
+        if(p == 1) {
+            /* chroma planes follow luma, w/stride scaled by subsampling */
+            nrows = src->height >> fmt->p.yuv.ysub2;
+            if(fmt->group == ZBAR_FMT_YUV_PLANAR) {
+                srcl >>= fmt->p.yuv.xsub2;
+                dstl >>= fmt->p.yuv.xsub2;
+            }
+            else
+                /* interleaved chroma pairs (sized as uvp_size) */
+                dstl = (src->width >> fmt->p.yuv.xsub2) << 1;
+            rowlen = dstl;
+        }
+        assert(src->datalen >= srcn + (nrows ? (nrows - 1) * srcl : 0));
+        for(y = 0; y < nrows; y++)
+            memcpy((uint8_t*)dst->data + dstn + y * dstl,
+                   (uint8_t*)src->data + srcn + y * srcl, rowlen);
+        srcn += srcl * nrows;
+        dstn += dstl * nrows;
+    }
+}
+
 /* make new image w/reference to the same image data */
 static void convert_copy (zbar_image_t *dst,
                           const zbar_format_def_t *dstfmt,
@@ -346,7 +410,15 @@ static void convert_copy (zbar_image_t *dst,
                           const zbar_format_def_t *srcfmt)
 {
     if(src->width == dst->width &&
-       src->height == dst->height) {
+       src->height == dst->height && src->stride) {
+        /* converted images are always packed */
+        const zbar_format_def_t *fmt = _zbar_format_lookup(src->format);
+        assert(fmt);
+        dst->cleanup = zbar_image_free_data;
+        convert_unpad(dst, src, fmt);
+    }
+    else if(src->width == dst->width &&
+            src->height == dst->height) {
         zbar_image_t *s = (zbar_image_t*)src;
         dst->data = src->data;
         dst->datalen = src->datalen;
@@ -354,9 +426,13 @@ static void convert_copy (zbar_image_t *dst,
         dst->next = s;
         _zbar_image_refcnt(s, 1);
     }
-    else
+    else {
         /* NB only for GRAY/YUV_PLANAR formats */
-        convert_y_resize(dst, dstfmt, src, srcfmt, dst->width * dst->height);
+        dst->datalen = dst->width * dst->height;
+        dst->data = malloc(dst->datalen);
+        if(!dst->data) return;
+        convert_y_resize(dst, dstfmt, src, srcfmt, dst->datalen);
+    }
 }
 
 /* append neutral UV plane to grayscale image */
@@ -386,10 +462,10 @@ static void convert_yuv_pack (zbar_image_t *dst,
                               const zbar_image_t *src,
                               const zbar_format_def_t *srcfmt)
 {
-    unsigned long srcm, srcn;
-    uint8_t flags, *srcy, *dstp;
-    const uint8_t *srcu, *srcv;
-    unsigned srcl, xmask, ymask, x, y;
+    unsigned long srcm = 0, srcn, srcl, srcs;
+    uint8_t flags, *dstp;
+    const uint8_t *srcu = NULL, *srcv = NULL;
+    unsigned xmask, x, y;
     uint8_t y0 = 0, y1 = 0, u = 0x80, v = 0x80;
 
     uv_roundup(dst, dstfmt);
@@ -398,36 +474,46 @@ static void convert_yuv_pack (zbar_image_t *dst,
     if(!dst->data) return;
     dstp = (void*)dst->data;
 
-    srcm = uvp_size(src, srcfmt);
-    srcn = src->width * src->height;
-    assert(src->datalen >= srcn + 2 * srcn);
+    /* chroma planes follow luma, w/stride scaled by subsampling */
+    srcl = row_stride(src, srcfmt);
+    srcs = srcl >> srcfmt->p.yuv.xsub2;
+    srcn = srcl * src->height;
+    if(srcfmt->group != ZBAR_FMT_GRAY)
+        srcm = srcs * (src->height >> srcfmt->p.yuv.ysub2);
+    assert(src->datalen >= srcn + 2 * srcm);
     flags = dstfmt->p.yuv.packorder ^ srcfmt->p.yuv.packorder;
-    srcy = (void*)src->data;
-    if(flags & 1) {
+    if(srcm && (flags & 1)) {
         srcv = (uint8_t*)src->data + srcn;
         srcu = srcv + srcm;
-    } else {
+    } else if(srcm) {
         srcu = (uint8_t*)src->data + srcn;
         srcv = srcu + srcm;
     }
     flags = dstfmt->p.yuv.packorder & 2;
 
-    srcl = src->width >> srcfmt->p.yuv.xsub2;
     xmask = (1 << srcfmt->p.yuv.xsub2) - 1;
-    ymask = (1 << srcfmt->p.yuv.ysub2) - 1;
     for(y = 0; y < dst->height; y++) {
-        if(y >= src->height) {
-            srcy -= src->width;
-            srcu -= srcl;  srcv -= srcl;
-        }
-        else if(y & ymask) {
-            srcu -= srcl;  srcv -= srcl;
+        /* duplicate last row to pad missing data */
+        unsigned sy = (y < src->height) ? y : src->height - 1;
+        const uint8_t *py = (uint8_t*)src->data + sy * srcl;
+        const uint8_t *pu = NULL, *pv = NULL;
+        if(srcm) {
+            unsigned sv = sy >> srcfmt->p.yuv.ysub2;
+            unsigned long off = srcm - srcs;
+            if(sv * srcs < off)
+                off = sv * srcs;
+            pu = srcu + off;
+            pv = srcv + off;
         }
         for(x = 0; x < dst->width; x += 2) {
             if(x < src->width) {
-                y0 = *(srcy++);  y1 = *(srcy++);
-                if(!(x & xmask)) {
-                    u = *(srcu++);  v = *(srcv++);
+                /* stay inside odd width rows */
+                y0 = *(py++);
+                y1 = (x + 1 < src->width) ? *(py++) : y0;
+                if(srcm && !(x & xmask) &&
+                   (x >> srcfmt->p.yuv.xsub2) <
+                   (src->width >> srcfmt->p.yuv.xsub2)) {
+                    u = *(pu++);  v = *(pv++);
                 }
             }
             if(flags) {
@@ -438,12 +524,6 @@ static void convert_yuv_pack (zbar_image_t *dst,
                 *(dstp++) = y1;  *(dstp++) = v;
             }
         }
-        for(; x < src->width; x += 2) {
-            srcy += 2;
-            if(!(x & xmask)) {
-                srcu++;  srcv++;
-            }
-        }
     }
 }
 
@@ -455,10 +535,9 @@ static void convert_yuv_unpack (zbar_image_t *dst,
                                 const zbar_image_t *src,
                                 const zbar_format_def_t *srcfmt)
 {
-    unsigned long dstn, dstm2;
+    unsigned long dstn, dstm2, srcl;
     uint8_t *dsty, flags;
-    const uint8_t *srcp;
-    unsigned srcl, x, y;
+    unsigned x, y;
     uint8_t y0 = 0, y1 = 0;
 
     uv_roundup(dst, dstfmt);
@@ -473,24 +552,23 @@ static void convert_yuv_unpack (zbar_image_t *dst,
 
     flags = srcfmt->p.yuv.packorder ^ dstfmt->p.yuv.packorder;
     flags &= 2;
-    srcp = src->data;
-    if(flags)
-        srcp++;
 
-    srcl = src->width + (src->width >> srcfmt->p.yuv.xsub2);
+    srcl = row_stride(src, srcfmt);
     for(y = 0; y < dst->height; y++) {
-        if(y >= src->height)
-            srcp -= srcl;
+        /* duplicate last row to pad missing data */
+        unsigned sy = (y < src->height) ? y : src->height - 1;
+        const uint8_t *srcp = (uint8_t*)src->data + sy * srcl;
+        if(flags)
+            srcp++;
         for(x = 0; x < dst->width; x += 2) {
             if(x < src->width) {
                 y0 = *(srcp++);  srcp++;
                 y1 = *(srcp++);  srcp++;
             }
             *(dsty++) = y0;
-            *(dsty++) = y1;
+            if(x + 1 < dst->width)
+                *(dsty++) = y1;
         }
-        if(x < src->width)
-            srcp += (src->width - x) * 2;
     }
 }
 
@@ -534,12 +612,11 @@ static void convert_uv_resample (zbar_image_t *dst,
     dstp = (void*)dst->data;
 
     flags = (srcfmt->p.yuv.packorder ^ dstfmt->p.yuv.packorder) & 1;
-    srcp = src->data;
-
-    srcl = src->width + (src->width >> srcfmt->p.yuv.xsub2);
+    srcl = row_stride(src, srcfmt);
     for(y = 0; y < dst->height; y++) {
-        if(y >= src->height)
-            srcp -= srcl;
+        /* duplicate last row to pad missing data */
+        srcp = (uint8_t*)src->data +
+            ((y < src->height) ? y : src->height - 1) * srcl;
         for(x = 0; x < dst->width; x += 2) {
             if(x < src->width) {
                 if(!(srcfmt->p.yuv.packorder & 2)) {
@@ -563,8 +640,6 @@ static void convert_uv_resample (zbar_image_t *dst,
                 *(dstp++) = v;  *(dstp++) = y1;
             }
         }
-        if(x < src->width)
-            srcp += (src->width - x) * 2;
     }
 }
 
@@ -576,9 +651,10 @@ static void convert_yuvp_to_rgb (zbar_image_t *dst,
                                  const zbar_image_t *src,
                                  const zbar_format_def_t *srcfmt)
 {
-    uint8_t *dstp, *srcy;
+    uint8_t *dstp;
+    const uint8_t *srcy;
     int drbits, drbit0, dgbits, dgbit0, dbbits, dbbit0;
-    unsigned long srcm, srcn;
+    unsigned long srcm, srcn, srcl;
     unsigned x, y;
     uint32_t p = 0;
 
@@ -594,14 +670,15 @@ static void convert_yuvp_to_rgb (zbar_image_t *dst,
     dbbits = RGB_SIZE(dstfmt->p.rgb.blue);
     dbbit0 = RGB_OFFSET(dstfmt->p.rgb.blue);
 
+    srcl = row_stride(src, srcfmt);
     srcm = uvp_size(src, srcfmt);
-    srcn = src->width * src->height;
+    srcn = srcl * src->height;
     assert(src->datalen >= srcn + 2 * srcm);
-    srcy = (void*)src->data;
 
     for(y = 0; y < dst->height; y++) {
-        if(y >= src->height)
-            srcy -= src->width;
+        /* duplicate last row to pad missing data */
+        srcy = (uint8_t*)src->data +
+            ((y < src->height) ? y : src->height - 1) * srcl;
         for(x = 0; x < dst->width; x++) {
             if(x < src->width) {
                 /* FIXME color space? */
@@ -613,8 +690,6 @@ static void convert_yuvp_to_rgb (zbar_image_t *dst,
             convert_write_rgb(dstp, p, dstfmt->p.rgb.bpp);
             dstp += dstfmt->p.rgb.bpp;
         }
-        if(x < src->width)
-            srcy += (src->width - x);
     }
 }
 
@@ -644,8 +719,6 @@ static void convert_rgb_to_yuvp (zbar_image_t *dst,
     dsty = (void*)dst->data;
 
     assert(src->datalen >= (src->width * src->height * srcfmt->p.rgb.bpp));
-    srcp = src->data;
-
     rbits = RGB_SIZE(srcfmt->p.rgb.red);
     rbit0 = RGB_OFFSET(srcfmt->p.rgb.red);
     gbits = RGB_SIZE(srcfmt->p.rgb.green);
@@ -653,10 +726,11 @@ static void convert_rgb_to_yuvp (zbar_image_t *dst,
     bbits = RGB_SIZE(srcfmt->p.rgb.blue);
     bbit0 = RGB_OFFSET(srcfmt->p.rgb.blue);
 
-    srcl = src->width * srcfmt->p.rgb.bpp;
+    srcl = row_stride(src, srcfmt);
     for(y = 0; y < dst->height; y++) {
-        if(y >= src->height)
-            srcp -= srcl;
+        /* duplicate last row to pad missing data */
+        srcp = (uint8_t*)src->data +
+            ((y < src->height) ? y : src->height - 1) * srcl;
         for(x = 0; x < dst->width; x++) {
             if(x < src->width) {
                 uint8_t r, g, b;
@@ -673,8 +747,6 @@ static void convert_rgb_to_yuvp (zbar_image_t *dst,
             }
             *(dsty++) = y0;
         }
-        if(x < src->width)
-            srcp += (src->width - x) * srcfmt->p.rgb.bpp;
     }
 }
 
@@ -705,15 +777,14 @@ static void convert_yuv_to_rgb (zbar_image_t *dst,
 
     assert(src->datalen >= (src->width * src->height +
                             uvp_size(src, srcfmt) * 2));
-    srcp = src->data;
-    if(srcfmt->p.yuv.packorder & 2)
-        srcp++;
-
     assert(srcfmt->p.yuv.xsub2 == 1);
-    srcl = src->width + (src->width >> 1);
+    srcl = row_stride(src, srcfmt);
     for(y = 0; y < dst->height; y++) {
-        if(y >= src->height)
-            srcp -= srcl;
+        /* duplicate last row to pad missing data */
+        srcp = (uint8_t*)src->data +
+            ((y < src->height) ? y : src->height - 1) * srcl;
+        if(srcfmt->p.yuv.packorder & 2)
+            srcp++;
         for(x = 0; x < dst->width; x++) {
             if(x < src->width) {
                 uint8_t y0 = *(srcp++);
@@ -733,8 +804,6 @@ static void convert_yuv_to_rgb (zbar_image_t *dst,
             convert_write_rgb(dstp, p, dstfmt->p.rgb.bpp);
             dstp += dstfmt->p.rgb.bpp;
         }
-        if(x < src->width)
-            srcp += (src->width - x) * 2;
     }
 }
 
@@ -760,8 +829,6 @@ static void convert_rgb_to_yuv (zbar_image_t *dst,
     flags = dstfmt->p.yuv.packorder & 2;
 
     assert(src->datalen >= (src->width * src->height * srcfmt->p.rgb.bpp));
-    srcp = src->data;
-
     rbits = RGB_SIZE(srcfmt->p.rgb.red);
     rbit0 = RGB_OFFSET(srcfmt->p.rgb.red);
     gbits = RGB_SIZE(srcfmt->p.rgb.green);
@@ -769,10 +836,11 @@ static void convert_rgb_to_yuv (zbar_image_t *dst,
     bbits = RGB_SIZE(srcfmt->p.rgb.blue);
     bbit0 = RGB_OFFSET(srcfmt->p.rgb.blue);
 
-    srcl = src->width * srcfmt->p.rgb.bpp;
+    srcl = row_stride(src, srcfmt);
     for(y = 0; y < dst->height; y++) {
-        if(y >= src->height)
-            srcp -= srcl;
+        /* duplicate last row to pad missing data */
+        srcp = (uint8_t*)src->data +
+            ((y < src->height) ? y : src->height - 1) * srcl;
         for(x = 0; x < dst->width; x++) {
             if(x < src->width) {
                 uint8_t r, g, b;
@@ -794,8 +862,6 @@ static void convert_rgb_to_yuv (zbar_image_t *dst,
                 *(dstp++) = y0;  *(dstp++) = 0x80;
             }
         }
-        if(x < src->width)
-            srcp += (src->width - x) * srcfmt->p.rgb.bpp;
     }
 }
 
@@ -826,8 +892,6 @@ static void convert_rgb_resample (zbar_image_t *dst,
     dbbit0 = RGB_OFFSET(dstfmt->p.rgb.blue);
 
     assert(src->datalen >= (src->width * src->height * srcfmt->p.rgb.bpp));
-    srcp = src->data;
-
     srbits = RGB_SIZE(srcfmt->p.rgb.red);
     srbit0 = RGB_OFFSET(srcfmt->p.rgb.red);
     sgbits = RGB_SIZE(srcfmt->p.rgb.green);
@@ -835,10 +899,11 @@ static void convert_rgb_resample (zbar_image_t *dst,
     sbbits = RGB_SIZE(srcfmt->p.rgb.blue);
     sbbit0 = RGB_OFFSET(srcfmt->p.rgb.blue);
 
-    srcl = src->width * srcfmt->p.rgb.bpp;
+    srcl = row_stride(src, srcfmt);
     for(y = 0; y < dst->height; y++) {
-        if(y >= src->height)
-            y -= srcl;
+        /* duplicate last row to pad missing data */
+        srcp = (uint8_t*)src->data +
+            ((y < src->height) ? y : src->height - 1) * srcl;
         for(x = 0; x < dst->width; x++) {
             if(x < src->width) {
                 uint8_t r, g, b;
@@ -857,8 +922,6 @@ static void convert_rgb_resample (zbar_image_t *dst,
             convert_write_rgb(dstp, p, dstfmt->p.rgb.bpp);
             dstp += dstfmt->p.rgb.bpp;
         }
-        if(x < src->width)
-            srcp += (src->width - x) * srcfmt->p.rgb.bpp;
     }
 }
 
@@ -952,6 +1015,39 @@ const zbar_format_def_t *_zbar_format_lookup (uint32_t fmt)
     return(NULL);
 }
 
+/* locate luma samples that may be scanned in place: grayscale, planar
+ * and NV formats start with a full resolution Y plane, packed YUV has
+ * luma in every other byte.  returns NULL if the image must be converted
+ */
+const uint8_t *_zbar_image_get_luma (const zbar_image_t *img,
+                                     unsigned *step,
+                                     unsigned *stride)
+{
+    const zbar_format_def_t *fmt = _zbar_format_lookup(img->format);
+    const uint8_t *data = img->data;
+    if(!fmt || !data)
+        return(NULL);
+
+    switch(fmt->group) {
+    case ZBAR_FMT_GRAY:
+    case ZBAR_FMT_YUV_PLANAR:
+    case ZBAR_FMT_YUV_NV:
+        *step = 1;
+        *stride = row_stride(img, fmt);
+        return(data);
+
+    case ZBAR_FMT_YUV_PACKED:
+        if(fmt->p.yuv.xsub2 != 1)
+            return(NULL);
+        *step = 2;
+        *stride = row_stride(img, fmt);
+        return(data + ((fmt->p.yuv.packorder & 2) ? 1 : 0));
+
+    default:
+        return(NULL);
+    }
+}
+
 #ifdef HAVE_LIBJPEG
 /* convert JPEG data via an intermediate format supported by libjpeg */
 static void convert_jpeg (zbar_image_t *dst,
@@ -24,7 +24,7 @@
 #include <config.h>
 #include <stdlib.h>     /* malloc, calloc, free */
 #include <stdio.h>      /* snprintf */
-#include <string.h>     /* memset, strlen */
+#include <string.h>     /* memset, memcpy, strlen */
 
 #include <zbar.h>
 
@@ -37,6 +37,60 @@
 #include "debug.h"
 #include "decoder.h"
 
+static inline void add_decoder (zbar_decoder_t *dcode,
+                                zbar_symbol_type_t (*decode)(zbar_decoder_t*),
+                                zbar_symbol_type_t min)
+{
+    decoder_entry_t *d = &dcode->decoders[dcode->ndecoders++];
+    d->decode = decode;
+    d->min = min;
+}
+
+/* collect decoders for enabled symbologies, in the original fixed order.
+ * EAN reports partial results too (the image scanner uses them)
+ */
+static void decoder_update_enabled (zbar_decoder_t *dcode)
+{
+    dcode->ndecoders = 0;
+#ifdef ENABLE_QRCODE
+    if(TEST_CFG(dcode->qrf.config, ZBAR_CFG_ENABLE))
+        add_decoder(dcode, _zbar_find_qr, ZBAR_PARTIAL);
+#endif
+#ifdef ENABLE_EAN
+    if(dcode->ean.enable)
+        add_decoder(dcode, _zbar_decode_ean, ZBAR_NONE);
+#endif
+#ifdef ENABLE_CODE39
+    if(TEST_CFG(dcode->code39.config, ZBAR_CFG_ENABLE))
+        add_decoder(dcode, _zbar_decode_code39, ZBAR_PARTIAL);
+#endif
+#ifdef ENABLE_CODE93
+    if(TEST_CFG(dcode->code93.config, ZBAR_CFG_ENABLE))
+        add_decoder(dcode, _zbar_decode_code93, ZBAR_PARTIAL);
+#endif
+#ifdef ENABLE_CODE128
+    if(TEST_CFG(dcode->code128.config, ZBAR_CFG_ENABLE))
+        add_decoder(dcode, _zbar_decode_code128, ZBAR_PARTIAL);
+#endif
+#ifdef ENABLE_DATABAR
+    if(TEST_CFG(dcode->databar.config | dcode->databar.config_exp,
+                ZBAR_CFG_ENABLE))
+        add_decoder(dcode, _zbar_decode_databar, ZBAR_PARTIAL);
+#endif
+#ifdef ENABLE_CODABAR
+    if(TEST_CFG(dcode->codabar.config, ZBAR_CFG_ENABLE))
+        add_decoder(dcode, _zbar_decode_codabar, ZBAR_PARTIAL);
+#endif
+#ifdef ENABLE_I25
+    if(TEST_CFG(dcode->i25.config, ZBAR_CFG_ENABLE))
+        add_decoder(dcode, _zbar_decode_i25, ZBAR_PARTIAL);
+#endif
+#ifdef ENABLE_PDF417
+    if(TEST_CFG(dcode->pdf417.config, ZBAR_CFG_ENABLE))
+        add_decoder(dcode, _zbar_decode_pdf417, ZBAR_PARTIAL);
+#endif
+}
+
 zbar_decoder_t *zbar_decoder_create ()
 {
     zbar_decoder_t *dcode = calloc(1, sizeof(zbar_decoder_t));
@@ -91,6 +145,7 @@ zbar_decoder_t *zbar_decoder_create ()
 #ifdef ENABLE_QRCODE
     dcode->qrf.config = 1 << ZBAR_CFG_ENABLE;
 #endif
+    decoder_update_enabled(dcode);
 
     zbar_decoder_reset(dcode);
     return(dcode);
@@ -176,6 +231,60 @@ void zbar_decoder_new_scan (zbar_decoder_t *dcode)
 }
 
 
+/* copy symbology configuration (but no decode state) between decoders */
+void _zbar_decoder_copy_config (zbar_decoder_t *dst,
+                                const zbar_decoder_t *src)
+{
+#ifdef ENABLE_EAN
+    dst->ean.enable = src->ean.enable;
+    dst->ean.ean13_config = src->ean.ean13_config;
+    dst->ean.ean8_config = src->ean.ean8_config;
+    dst->ean.upca_config = src->ean.upca_config;
+    dst->ean.upce_config = src->ean.upce_config;
+    dst->ean.isbn10_config = src->ean.isbn10_config;
+    dst->ean.isbn13_config = src->ean.isbn13_config;
+    dst->ean.ean5_config = src->ean.ean5_config;
+    dst->ean.ean2_config = src->ean.ean2_config;
+#endif
+#ifdef ENABLE_I25
+    dst->i25.config = src->i25.config;
+    memcpy(dst->i25.configs, src->i25.configs, sizeof(dst->i25.configs));
+#endif
+#ifdef ENABLE_DATABAR
+    dst->databar.config = src->databar.config;
+    dst->databar.config_exp = src->databar.config_exp;
+#endif
+#ifdef ENABLE_CODABAR
+    dst->codabar.config = src->codabar.config;
+    memcpy(dst->codabar.configs, src->codabar.configs,
+           sizeof(dst->codabar.configs));
+#endif
+#ifdef ENABLE_CODE39
+    dst->code39.config = src->code39.config;
+    memcpy(dst->code39.configs, src->code39.configs,
+           sizeof(dst->code39.configs));
+#endif
+#ifdef ENABLE_CODE93
+    dst->code93.config = src->code93.config;
+    memcpy(dst->code93.configs, src->code93.configs,
+           sizeof(dst->code93.configs));
+#endif
+#ifdef ENABLE_CODE128
+    dst->code128.config = src->code128.config;
+    memcpy(dst->code128.configs, src->code128.configs,
+           sizeof(dst->code128.configs));
+#endif
+#ifdef ENABLE_PDF417
+    dst->pdf417.config = src->pdf417.config;
+    memcpy(dst->pdf417.configs, src->pdf417.configs,
+           sizeof(dst->pdf417.configs));
+#endif
+#ifdef ENABLE_QRCODE
+    dst->qrf.config = src->qrf.config;
+#endif
+    decoder_update_enabled(dst);
+}
+
 zbar_color_t zbar_decoder_get_color (const zbar_decoder_t *dcode)
 {
     return(get_color(dcode));
@@ -230,6 +339,7 @@ zbar_symbol_type_t zbar_decode_width (zbar_decoder_t *dcode,
                                       unsigned w)
 {
     zbar_symbol_type_t tmp, sym = ZBAR_NONE;
+    const decoder_entry_t *d;
 
     dcode->w[dcode->idx & (DECODE_WINDOW - 1)] = w;
     dbprintf(1, "    decode[%x]: w=%d (%g)\n", dcode->idx, w, (w / 32.));
@@ -239,54 +349,12 @@ zbar_symbol_type_t zbar_decode_width (zbar_decoder_t *dcode,
     dcode->s6 += get_width(dcode, 1);
 
     /* each decoder processes width stream in parallel */
-#ifdef ENABLE_QRCODE
-    if(TEST_CFG(dcode->qrf.config, ZBAR_CFG_ENABLE) &&
-       (tmp = _zbar_find_qr(dcode)) > ZBAR_PARTIAL)
-        sym = tmp;
-#endif
-#ifdef ENABLE_EAN
-    if((dcode->ean.enable) &&
-       (tmp = _zbar_decode_ean(dcode)))
-        sym = tmp;
-#endif
-#ifdef ENABLE_CODE39
-    if(TEST_CFG(dcode->code39.config, ZBAR_CFG_ENABLE) &&
-       (tmp = _zbar_decode_code39(dcode)) > ZBAR_PARTIAL)
-        sym = tmp;
-#endif
-#ifdef ENABLE_CODE93
-    if(TEST_CFG(dcode->code93.config, ZBAR_CFG_ENABLE) &&
-       (tmp = _zbar_decode_code93(dcode)) > ZBAR_PARTIAL)
-        sym = tmp;
-#endif
-#ifdef ENABLE_CODE128
-    if(TEST_CFG(dcode->code128.config, ZBAR_CFG_ENABLE) &&
-       (tmp = _zbar_decode_code128(dcode)) > ZBAR_PARTIAL)
-        sym = tmp;
-#endif
-#ifdef ENABLE_DATABAR
-    if(TEST_CFG(dcode->databar.config | dcode->databar.config_exp,
-                ZBAR_CFG_ENABLE) &&
-       (tmp = _zbar_decode_databar(dcode)) > ZBAR_PARTIAL)
-        sym = tmp;
-#endif
-#ifdef ENABLE_CODABAR
-    if(TEST_CFG(dcode->codabar.config, ZBAR_CFG_ENABLE) &&
-       (tmp = _zbar_decode_codabar(dcode)) > ZBAR_PARTIAL)
-        sym = tmp;
-#endif
-#ifdef ENABLE_I25
-    if(TEST_CFG(dcode->i25.config, ZBAR_CFG_ENABLE) &&
-       (tmp = _zbar_decode_i25(dcode)) > ZBAR_PARTIAL)
-        sym = tmp;
-#endif
-#ifdef ENABLE_PDF417
-    if(TEST_CFG(dcode->pdf417.config, ZBAR_CFG_ENABLE) &&
-       (tmp = _zbar_decode_pdf417(dcode)) > ZBAR_PARTIAL)
-        sym = tmp;
-#endif
+    for(d = dcode->decoders; d < dcode->decoders + dcode->ndecoders; d++)
+        if((tmp = d->decode(dcode)) > d->min)
+            sym = tmp;
 
     dcode->idx++;
+    dcode->nwidths++;
     dcode->type = sym;
     if(sym) {
         if(dcode->lock && sym > ZBAR_PARTIAL && sym != ZBAR_QRCODE)
@@ -297,6 +365,17 @@ zbar_symbol_type_t zbar_decode_width (zbar_decoder_t *dcode,
     return(sym);
 }
 
+/* widths decoded since the last call, for scan statistics */
+unsigned long _zbar_decoder_take_widths (zbar_decoder_t *dcode,
+                                        unsigned *ndecoders)
+{
+    unsigned long n = dcode->nwidths;
+    dcode->nwidths = 0;
+    if(ndecoders)
+        *ndecoders = dcode->ndecoders;
+    return(n);
+}
+
 static inline const unsigned int*
 decoder_get_configp (const zbar_decoder_t *dcode,
                      zbar_symbol_type_t sym)
@@ -430,6 +509,7 @@ static inline int decoder_set_config_bool (zbar_decoder_t *dcode,
                                  dcode->ean.isbn13_config,
                                  ZBAR_CFG_ENABLE);
 #endif
+    decoder_update_enabled(dcode);
 
     return(0);
 }
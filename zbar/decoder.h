@@ -87,6 +87,15 @@
 #define TEST_CFG(config, cfg) (((config) >> (cfg)) & 1)
 #define MOD(mod) (1 << (mod))
 
+/* maximum number of symbology decoders */
+#define NUM_DECODERS 9
+
+/* enabled symbology decoder, in dispatch order */
+typedef struct decoder_entry_s {
+    zbar_symbol_type_t (*decode)(zbar_decoder_t*);
+    zbar_symbol_type_t min;             /* results above this are reported */
+} decoder_entry_t;
+
 /* symbology independent decoder state */
 struct zbar_decoder_s {
     unsigned char idx;                  /* current width index */
@@ -104,6 +113,11 @@ struct zbar_decoder_s {
     void *userdata;                     /* application data */
     zbar_decoder_handler_t *handler;    /* application callback */
 
+    /* decoders for enabled symbologies, rebuilt on config change */
+    decoder_entry_t decoders[NUM_DECODERS];
+    unsigned ndecoders;
+    unsigned long nwidths;              /* widths decoded (statistics) */
+
     /* symbology specific state */
 #ifdef ENABLE_EAN
     ean_decoder_t ean;                  /* EAN/UPC parallel decode attempts */
@@ -94,6 +94,11 @@ void zbar_image_get_crop (const zbar_image_t *img,
     if(h) *h = img->crop_h;
 }
 
+unsigned zbar_image_get_stride (const zbar_image_t *img)
+{
+    return(img->stride);
+}
+
 const void *zbar_image_get_data (const zbar_image_t *img)
 {
     return(img->data);
@@ -125,6 +130,12 @@ void zbar_image_set_size (zbar_image_t *img,
     img->height = img->crop_h = h;
 }
 
+void zbar_image_set_stride (zbar_image_t *img,
+                            unsigned stride)
+{
+    img->stride = stride;
+}
+
 void zbar_image_set_crop (zbar_image_t *img,
                           unsigned x,
                           unsigned y,
@@ -204,6 +215,7 @@ zbar_image_t *zbar_image_copy (const zbar_image_t *src)
     zbar_image_t *dst = zbar_image_create();
     dst->format = src->format;
     _zbar_image_copy_size(dst, src);
+    dst->stride = src->stride;
     dst->datalen = src->datalen;
     dst->data = malloc(src->datalen);
     assert(dst->data);
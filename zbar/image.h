@@ -64,6 +64,7 @@ struct zbar_image_s {
     unsigned long datalen;      /* allocated/mapped size of data */
     unsigned crop_x, crop_y;    /* crop rectangle */
     unsigned crop_w, crop_h;
+    unsigned stride;            /* bytes between rows (0 = packed) */
     void *userdata;             /* user specified data associated w/image */
 
     /* cleanup handler */
@@ -101,6 +102,8 @@ typedef struct zbar_format_def_s {
 
 extern int _zbar_best_format(uint32_t, uint32_t*, const uint32_t*);
 extern const zbar_format_def_t *_zbar_format_lookup(uint32_t);
+extern const uint8_t *_zbar_image_get_luma(const zbar_image_t*,
+                                          unsigned*, unsigned*);
 extern void _zbar_image_free(zbar_image_t*);
 
 #ifdef DEBUG_SVG
@@ -36,19 +36,13 @@
 #include "error.h"
 #include "image.h"
 #include "timer.h"
+#include "thread.h"
 #ifdef ENABLE_QRCODE
 # include "qrcode.h"
 #endif
 #include "img_scanner.h"
 #include "svg.h"
 
-#if 1
-# define ASSERT_POS \
-    assert(p == data + x + y * (intptr_t)w)
-#else
-# define ASSERT_POS
-#endif
-
 /* FIXME cache setting configurability */
 
 /* time interval for which two images are considered "nearby"
@@ -64,9 +58,31 @@
  */
 #define CACHE_TIMEOUT     (CACHE_HYSTERESIS * 2) /* ms */
 
-#define NUM_SCN_CFGS (ZBAR_CFG_Y_DENSITY - ZBAR_CFG_X_DENSITY + 1)
+/* cache entries are expired by a timer wheel: each slot holds the entries
+ * due to expire during one tick.  the wheel must span the timeout
+ */
+#define CACHE_TICK        250 /* ms */
+#define CACHE_SLOTS       32
+
+/* extra space scanned around the predicted location of a tracked symbol
+ */
+#define TRACK_MARGIN      16 /* pixels */
+
+/* cache entries located by the previous scan (see track_sym) */
+#define TRACKED(entry) ((entry)->npts == 4)
+
+/* unchanged images are detected by comparing the mean luma of a grid of
+ * tiles, sampled sparsely
+ */
+#define SIG_GRID          16 /* tiles per side */
+#define SIG_SUBSAMPLE     4  /* pixels */
+
+#define NUM_SCN_CFGS (ZBAR_CFG_MAX_RESULTS - ZBAR_CFG_X_DENSITY + 1)
+#define NUM_SYM_CFGS (ZBAR_CFG_STOP_AFTER - ZBAR_CFG_UNCERTAINTY + 1)
 
 #define CFG(iscn, cfg) ((iscn)->configs[(cfg) - ZBAR_CFG_X_DENSITY])
+#define SYM_CFG(iscn, cfg, h) \
+    ((iscn)->sym_configs[(cfg) - ZBAR_CFG_UNCERTAINTY][h])
 #define TEST_CFG(iscn, cfg) (((iscn)->config >> ((cfg) - ZBAR_CFG_POSITION)) & 1)
 
 #ifndef NO_STATS
@@ -76,17 +92,108 @@
 # define dump_stats(...)
 #endif
 
+/* recycled symbols are kept in buckets by inline data size */
 #define RECYCLE_BUCKETS     5
+#define RECYCLE_DATA(i)     (16 << ((i) * 2))
+#define RECYCLE_MAX         256
+
+/* number of vertical scan lines transposed together */
+#define TILE_LINES          32
 
 typedef struct recycle_bucket_s {
     int nsyms;
     zbar_symbol_t *head;
 } recycle_bucket_t;
 
+/* maximum number of scan threads */
+#define MAX_THREADS         64
+
+/* decoder result recorded for deferred merge */
+typedef struct scan_hit_s {
+    zbar_symbol_type_t type;    /* decoded symbol type */
+    unsigned data, datalen;     /* offset and length of recorded data */
+    unsigned configs;           /* symbology configuration */
+    unsigned modifiers;         /* symbology modifiers */
+    zbar_orientation_t orient;  /* decoded orientation */
+    int x, y;                   /* decoded position */
+    int vert;                   /* direction of scan line that found it */
+#ifdef ENABLE_QRCODE
+    qr_finder_line line;        /* QR finder line (type == ZBAR_QRCODE) */
+#endif
+} scan_hit_t;
+
+/* scan line of a two-phase pass, decoded from its recorded edges */
+typedef struct edge_line_s {
+    int seg;                    /* pass of image scan (see redecode_lines) */
+    int vert, v, du, umin;      /* scan line geometry */
+    unsigned e0, ne;            /* recorded edges of line */
+} edge_line_t;
+
+/* linear scan state, one per concurrently scanned set of lines */
+typedef struct scan_ctx_s {
+    zbar_image_scanner_t *iscn; /* owning image scanner */
+    zbar_scanner_t *scn;        /* linear intensity scanner */
+    zbar_decoder_t *dcode;      /* symbol decoder */
+    int dx, dy, du, umin, v;    /* current scan direction */
+
+    int timeout;                /* stopped at deadline */
+
+    /* statistics of current image */
+    unsigned long time[2];      /* time spent scanning each pass */
+    unsigned long npartials;    /* partial symbols decoded */
+
+    /* results are merged immediately unless recording */
+    int record;
+    int nhits, hits_alloc;      /* recorded results */
+    scan_hit_t *hits;
+    unsigned datalen, data_alloc; /* recorded result data */
+    char *data;
+
+    uint8_t *tile;              /* transposed block of vertical lines */
+    unsigned tile_alloc;
+
+    edge_line_t *elines;        /* lines with edges kept by the scanner */
+    int nelines, elines_alloc;
+} scan_ctx_t;
+
+/* QR finder line candidate found by a coarse pass */
+typedef struct finder_cand_s {
+    int x, y;                   /* center of finder line */
+    int len;                    /* length of center run (0 = none) */
+} finder_cand_t;
+
+/* open addressing (linear probing) hash table of symbols,
+ * keyed on type and data
+ */
+typedef struct sym_table_s {
+    zbar_symbol_t **slot;       /* entries (or NULL) */
+    unsigned size;              /* number of slots (power of 2, or 0) */
+    unsigned n;                 /* number of entries */
+} sym_table_t;
+
+/* geometry of one scan pass (horizontal or vertical) */
+typedef struct scan_pass_s {
+    int density;                /* line spacing */
+    int border;                 /* position of first line */
+    int nlines;                 /* number of lines in pass */
+    const int *lines;           /* explicit line positions (or NULL) */
+    int u0, un;                 /* extent of each line */
+} scan_pass_t;
+
+#ifdef HAVE_THREADS
+/* additional scan thread state */
+typedef struct scan_worker_s {
+    scan_ctx_t ctx;             /* worker scan state */
+    zbar_thread_t thread;       /* worker thread */
+    int busy;                   /* band assigned and not yet finished */
+    int k0[2], k1[2];           /* assigned lines [k0, k1) of each pass */
+    int nhits0;                 /* recorded results from first pass */
+} scan_worker_t;
+#endif
+
 /* image scanner state */
 struct zbar_image_scanner_s {
-    zbar_scanner_t *scn;        /* associated linear intensity scanner */
-    zbar_decoder_t *dcode;      /* associated symbol decoder */
+    scan_ctx_t ctx;             /* associated linear scanner and decoder */
 #ifdef ENABLE_QRCODE
     qr_reader *qr;              /* QR Code 2D reader */
 #endif
@@ -97,19 +204,63 @@ struct zbar_image_scanner_s {
 
     unsigned long time;         /* scan start time */
     zbar_image_t *img;          /* currently scanning image *root* */
-    int dx, dy, du, umin, v;    /* current scan direction */
+    const uint8_t *luma;        /* first luma sample of img */
+    unsigned luma_step;         /* luma sample spacing along a row */
+    unsigned luma_stride;       /* luma sample spacing between rows */
+    scan_pass_t pass[2];        /* current image scan geometry */
+
+    unsigned long deadline_us;  /* time limit of each scan (0 = none) */
+    zbar_timer_t deadline;      /* end of current scan */
+
+    /* edge lists kept from last scan (ZBAR_CFG_EDGE_LIST) */
+    int nsegs;                  /* passes with kept edges (0 = none) */
+    unsigned edges_w, edges_h;  /* size of image they were extracted from */
+
+    /* coarse-to-fine scanning state */
+    int coarse;                 /* density of coarse pass in progress */
+    int fine_density[2];        /* density of each refined pass (or 0) */
+    uint8_t *marks;             /* rows then columns needing a fine scan */
+    int *lines;                 /* fine scan line positions */
+    finder_cand_t *cands;       /* per cell horizontal/vertical candidates */
+    unsigned marks_alloc, lines_alloc, cands_alloc;
     zbar_symbol_set_t *syms;    /* previous decode results */
+    sym_table_t results;        /* index of current image results */
     /* recycled symbols in 4^n size buckets */
     recycle_bucket_t recycle[RECYCLE_BUCKETS];
 
     int enable_cache;           /* current result cache state */
-    zbar_symbol_t *cache;       /* inter-image result cache entries */
+    zbar_symbol_t *cache[CACHE_SLOTS]; /* inter-image result cache entries */
+    sym_table_t cache_index;    /* index of cache entries */
+    unsigned long cache_tick;   /* last expired cache tick */
+    int track_frames;           /* images scanned since last full scan */
+
+    /* unchanged image detection state */
+    uint8_t sig[SIG_GRID * SIG_GRID]; /* signature of last scanned image */
+    unsigned sig_x, sig_y, sig_w, sig_h; /* crop of signature (w 0 = none) */
+    int skipped;                /* images skipped since last scan */
+
+    /* scan statistics (see zbar_image_scanner_get_stats) */
+    int enable_stats;           /* collect statistics */
+    zbar_scan_stats_t stats;    /* statistics of last scanned image */
+    unsigned long times[NUM_SCAN_STAGES]; /* time spent in each stage */
 
     /* configuration settings */
     unsigned config;            /* config flags */
     unsigned ean_config;
     int configs[NUM_SCN_CFGS];  /* int valued configurations */
-    int sym_configs[1][NUM_SYMS]; /* per-symbology configurations */
+    int sym_configs[NUM_SYM_CFGS][NUM_SYMS]; /* per-symbology configs */
+
+    /* early exit state (see confirm_sym) */
+    int nconfirmed;             /* confirmed results of current image */
+    int sym_confirmed[NUM_SYMS]; /* confirmed results of each symbology */
+    int satisfied;              /* requested results found */
+
+#ifdef HAVE_THREADS
+    zbar_mutex_t mutex;         /* scan thread synchronization */
+    zbar_event_t done;          /* all assigned bands finished */
+    int nworkers, nbusy;        /* additional scan threads */
+    scan_worker_t *workers;
+#endif
 
 #ifndef NO_STATS
     int stat_syms_new;
@@ -137,10 +288,6 @@ void _zbar_image_scanner_recycle_syms (zbar_image_scanner_t *iscn,
             int i;
             recycle_bucket_t *bucket;
             /* recycle unreferenced symbol */
-            if(!sym->data_alloc) {
-                sym->data = NULL;
-                sym->datalen = 0;
-            }
             if(sym->syms) {
                 if(_zbar_refcnt(&sym->syms->refcnt, -1))
                     assert(0);
@@ -149,18 +296,25 @@ void _zbar_image_scanner_recycle_syms (zbar_image_scanner_t *iscn,
                 _zbar_symbol_set_free(sym->syms);
                 sym->syms = NULL;
             }
-            for(i = 0; i < RECYCLE_BUCKETS; i++)
-                if(sym->data_alloc < 1 << (i * 2))
+            for(i = 0; i < RECYCLE_BUCKETS - 1; i++)
+                if(sym->inline_alloc <= RECYCLE_DATA(i))
                     break;
-            if(i == RECYCLE_BUCKETS) {
-                assert(sym->data);
+            bucket = &iscn->recycle[i];
+            if(bucket->nsyms >= RECYCLE_MAX) {
+                _zbar_symbol_free(sym);
+                continue;
+            }
+
+            /* only the block itself is kept */
+            if(sym->data_alloc && sym->data != SYM_INLINE_DATA(sym))
                 free(sym->data);
-                sym->data = NULL;
-                sym->data_alloc = 0;
-                i = 0;
+            sym->data = NULL;
+            sym->datalen = sym->data_alloc = 0;
+            if(sym->pts != sym->inline_pts) {
+                free(sym->pts);
+                sym->pts = sym->inline_pts;
+                sym->pts_alloc = SYM_OUTLINE_MAX;
             }
-            bucket = &iscn->recycle[i];
-            /* FIXME cap bucket fill */
             bucket->nsyms++;
             sym->next = bucket->head;
             bucket->head = sym;
@@ -213,27 +367,25 @@ _zbar_image_scanner_alloc_sym (zbar_image_scanner_t *iscn,
                                zbar_symbol_type_t type,
                                int datalen)
 {
-    /* recycle old or alloc new symbol */
-    zbar_symbol_t *sym = NULL;
+    /* recycle old or alloc new symbol, w/data and points in one block */
+    zbar_symbol_t *sym;
     int i;
     for(i = 0; i < RECYCLE_BUCKETS - 1; i++)
-        if(datalen <= 1 << (i * 2))
-            break;
-
-    for(; i > 0; i--)
-        if((sym = iscn->recycle[i].head)) {
-            STAT(sym_recycle[i]);
+        if(datalen <= RECYCLE_DATA(i))
             break;
-        }
 
-    if(sym) {
+    if((sym = iscn->recycle[i].head)) {
+        STAT(sym_recycle[i]);
         iscn->recycle[i].head = sym->next;
         sym->next = NULL;
         assert(iscn->recycle[i].nsyms);
         iscn->recycle[i].nsyms--;
     }
     else {
-        sym = calloc(1, sizeof(zbar_symbol_t));
+        sym = calloc(1, sizeof(zbar_symbol_t) + RECYCLE_DATA(i));
+        sym->inline_alloc = RECYCLE_DATA(i);
+        sym->pts = sym->inline_pts;
+        sym->pts_alloc = SYM_OUTLINE_MAX;
         STAT(sym_new);
     }
 
@@ -248,43 +400,198 @@ _zbar_image_scanner_alloc_sym (zbar_image_scanner_t *iscn,
 
     if(datalen > 0) {
         sym->datalen = datalen - 1;
-        if(sym->data_alloc < datalen) {
-            if(sym->data)
-                free(sym->data);
-            sym->data_alloc = datalen;
+        if(datalen <= sym->inline_alloc) {
+            sym->data = SYM_INLINE_DATA(sym);
+            sym->data_alloc = sym->inline_alloc;
+        }
+        else {
+            /* too long for any bucket */
             sym->data = malloc(datalen);
+            sym->data_alloc = datalen;
         }
     }
-    else {
-        if(sym->data)
-            free(sym->data);
-        sym->data = NULL;
-        sym->datalen = sym->data_alloc = 0;
-    }
     return(sym);
 }
 
+/* FNV-1a hash of symbol type and data */
+static inline unsigned sym_hash (zbar_symbol_type_t type,
+                                 const char *data,
+                                 unsigned datalen)
+{
+    uint32_t h = 2166136261u ^ type;
+    unsigned i;
+    for(i = 0; i < datalen; i++) {
+        h ^= (uint8_t)data[i];
+        h *= 16777619;
+    }
+    return(h);
+}
+
+static zbar_symbol_t *table_find (const sym_table_t *tbl,
+                                  zbar_symbol_type_t type,
+                                  const char *data,
+                                  unsigned datalen)
+{
+    unsigned mask = tbl->size - 1, i;
+    zbar_symbol_t *sym;
+    if(!tbl->n)
+        return(NULL);
+    for(i = sym_hash(type, data, datalen) & mask;
+        (sym = tbl->slot[i]);
+        i = (i + 1) & mask)
+        if(sym->type == type &&
+           sym->datalen == datalen &&
+           !memcmp(sym->data, data, datalen))
+            return(sym);
+    return(NULL);
+}
+
+static inline void table_put (sym_table_t *tbl,
+                              zbar_symbol_t *sym)
+{
+    unsigned mask = tbl->size - 1;
+    unsigned i = sym_hash(sym->type, sym->data, sym->datalen) & mask;
+    while(tbl->slot[i])
+        i = (i + 1) & mask;
+    tbl->slot[i] = sym;
+    tbl->n++;
+}
+
+/* index a symbol, growing the table to keep it at most half full.
+ * (an entry that can not be allocated is simply not found)
+ */
+static void table_add (sym_table_t *tbl,
+                       zbar_symbol_t *sym)
+{
+    if((tbl->n + 1) * 2 > tbl->size) {
+        zbar_symbol_t **old = tbl->slot;
+        unsigned i, size = tbl->size;
+        tbl->size = (size) ? size * 2 : 16;
+        tbl->slot = calloc(tbl->size, sizeof(zbar_symbol_t*));
+        if(!tbl->slot) {
+            tbl->slot = old;
+            tbl->size = size;
+            return;
+        }
+        tbl->n = 0;
+        for(i = 0; i < size; i++)
+            if(old[i])
+                table_put(tbl, old[i]);
+        if(old)
+            free(old);
+    }
+    table_put(tbl, sym);
+}
+
+/* remove an indexed symbol, shifting back any following entries
+ * that would no longer be reachable
+ */
+static void table_remove (sym_table_t *tbl,
+                          const zbar_symbol_t *sym)
+{
+    unsigned mask = tbl->size - 1, i, j;
+    if(!tbl->n)
+        return;
+    i = sym_hash(sym->type, sym->data, sym->datalen) & mask;
+    while(tbl->slot[i] != sym) {
+        if(!tbl->slot[i])
+            return;
+        i = (i + 1) & mask;
+    }
+    for(j = (i + 1) & mask; tbl->slot[j]; j = (j + 1) & mask) {
+        const zbar_symbol_t *next = tbl->slot[j];
+        unsigned k = sym_hash(next->type, next->data, next->datalen) & mask;
+        /* move back unless its home slot lies cyclically in (i, j] */
+        if((i < j) ? (k <= i || k > j) : (k <= i && k > j)) {
+            tbl->slot[i] = tbl->slot[j];
+            i = j;
+        }
+    }
+    tbl->slot[i] = NULL;
+    tbl->n--;
+}
+
+static inline void table_clear (sym_table_t *tbl)
+{
+    if(tbl->n) {
+        memset(tbl->slot, 0, tbl->size * sizeof(zbar_symbol_t*));
+        tbl->n = 0;
+    }
+}
+
+static inline void table_free (sym_table_t *tbl)
+{
+    if(tbl->slot)
+        free(tbl->slot);
+    tbl->slot = NULL;
+    tbl->size = tbl->n = 0;
+}
+
 static inline zbar_symbol_t *cache_lookup (zbar_image_scanner_t *iscn,
                                            zbar_symbol_t *sym)
 {
-    /* search for matching entry in cache */
-    zbar_symbol_t **entry = &iscn->cache;
-    while(*entry) {
-        if((*entry)->type == sym->type &&
-           (*entry)->datalen == sym->datalen &&
-           !memcmp((*entry)->data, sym->data, sym->datalen))
-            break;
-        if((sym->time - (*entry)->time) > CACHE_TIMEOUT) {
-            /* recycle stale cache entry */
-            zbar_symbol_t *next = (*entry)->next;
-            (*entry)->next = NULL;
-            _zbar_image_scanner_recycle_syms(iscn, *entry);
-            *entry = next;
+    return(table_find(&iscn->cache_index, sym->type,
+                      sym->data, sym->datalen));
+}
+
+/* file a cache entry in the wheel slot for its expiry tick */
+static inline void cache_file (zbar_image_scanner_t *iscn,
+                               zbar_symbol_t *entry)
+{
+    unsigned long tick = (entry->time + CACHE_TIMEOUT) / CACHE_TICK;
+    unsigned i;
+    if(tick - iscn->cache_tick - 1 >= CACHE_SLOTS)
+        /* already due (or clock skew) */
+        tick = iscn->cache_tick + 1;
+    i = tick % CACHE_SLOTS;
+    entry->next = iscn->cache[i];
+    iscn->cache[i] = entry;
+}
+
+/* recycle cache entries not seen for the timeout.  entries seen since
+ * they were filed are moved to the slot of their new expiry
+ */
+static void cache_expire (zbar_image_scanner_t *iscn)
+{
+    unsigned long tick = iscn->time / CACHE_TICK, t;
+    zbar_symbol_t *due = NULL, *entry, *next;
+    unsigned n = tick - iscn->cache_tick;
+
+    if(n > CACHE_SLOTS)
+        n = CACHE_SLOTS;
+    for(t = tick - n + 1; n; n--, t++) {
+        zbar_symbol_t **slot = &iscn->cache[t % CACHE_SLOTS];
+        for(entry = *slot; entry; entry = next) {
+            next = entry->next;
+            entry->next = due;
+            due = entry;
+        }
+        *slot = NULL;
+    }
+    iscn->cache_tick = tick;
+
+    for(entry = due; entry; entry = next) {
+        next = entry->next;
+        if(iscn->time - entry->time > CACHE_TIMEOUT) {
+            table_remove(&iscn->cache_index, entry);
+            entry->next = NULL;
+            _zbar_image_scanner_recycle_syms(iscn, entry);
         }
         else
-            entry = &(*entry)->next;
+            cache_file(iscn, entry);
     }
-    return(*entry);
+}
+
+/* recycle all cache entries */
+static void cache_flush (zbar_image_scanner_t *iscn)
+{
+    int i;
+    for(i = 0; i < CACHE_SLOTS; i++)
+        if(iscn->cache[i]) {
+            _zbar_image_scanner_recycle_syms(iscn, iscn->cache[i]);
+            iscn->cache[i] = NULL;
+        }
+    table_clear(&iscn->cache_index);
 }
 
 static inline void cache_sym (zbar_image_scanner_t *iscn,
@@ -303,8 +610,8 @@ static inline void cache_sym (zbar_image_scanner_t *iscn,
             entry->time = sym->time - CACHE_HYSTERESIS;
             entry->cache_count = 0;
             /* add to cache */
-            entry->next = iscn->cache;
-            iscn->cache = entry;
+            table_add(&iscn->cache_index, entry);
+            cache_file(iscn, entry);
         }
 
         /* consistency check and hysteresis */
@@ -316,7 +623,7 @@ static inline void cache_sym (zbar_image_scanner_t *iscn,
         if((!dup && !near_thresh) || far_thresh) {
             int type = sym->type;
             int h = _zbar_get_symbol_hash(type);
-            entry->cache_count = -iscn->sym_configs[0][h];
+            entry->cache_count = -SYM_CFG(iscn, ZBAR_CFG_UNCERTAINTY, h);
         }
         else if(dup || near_thresh)
             entry->cache_count++;
@@ -327,11 +634,55 @@ static inline void cache_sym (zbar_image_scanner_t *iscn,
         sym->cache_count = 0;
 }
 
+/* quality a result needs to be kept by the final filter (see finish_scan)
+ * FIXME tmp hack to filter bad EAN results
+ */
+static inline int confirm_quality (const zbar_image_scanner_t *iscn,
+                                   zbar_symbol_type_t type)
+{
+    int filter = (!iscn->enable_cache &&
+                  (CFG(iscn, ZBAR_CFG_X_DENSITY) == 1 ||
+                   CFG(iscn, ZBAR_CFG_Y_DENSITY) == 1));
+    if(type == ZBAR_CODABAR ||
+       (filter && ((type < ZBAR_COMPOSITE && type > ZBAR_PARTIAL) ||
+                   type == ZBAR_DATABAR || type == ZBAR_DATABAR_EXP)))
+        return(4);
+    return(1);
+}
+
+int _zbar_image_scanner_satisfied (const zbar_image_scanner_t *iscn,
+                                   zbar_symbol_type_t type,
+                                   int n)
+{
+    int h = _zbar_get_symbol_hash(type);
+    int max = CFG(iscn, ZBAR_CFG_MAX_RESULTS);
+    int stop = SYM_CFG(iscn, ZBAR_CFG_STOP_AFTER, h);
+    return(iscn->satisfied ||
+           (max > 0 && iscn->nconfirmed + n >= max) ||
+           (stop > 0 && iscn->sym_confirmed[h] + n >= stop));
+}
+
+/* count a reported result once it reaches the confirmation quality,
+ * stopping the scan when enough results are found
+ */
+static inline void confirm_sym (zbar_image_scanner_t *iscn,
+                                const zbar_symbol_t *sym)
+{
+    if(sym->cache_count || sym->quality != confirm_quality(iscn, sym->type))
+        return;
+    iscn->nconfirmed++;
+    iscn->sym_confirmed[_zbar_get_symbol_hash(sym->type)]++;
+    if(_zbar_image_scanner_satisfied(iscn, sym->type, 0))
+        iscn->satisfied = 1;
+}
+
 void _zbar_image_scanner_add_sym(zbar_image_scanner_t *iscn,
                                  zbar_symbol_t *sym)
 {
     zbar_symbol_set_t *syms;
     cache_sym(iscn, sym);
+    confirm_sym(iscn, sym);
+    table_add(&iscn->results, sym);
 
     syms = iscn->syms;
     if(sym->cache_count || !syms->tail) {
@@ -351,6 +702,58 @@ void _zbar_image_scanner_add_sym(zbar_image_scanner_t *iscn,
     _zbar_symbol_refcnt(sym, 1);
 }
 
+static inline scan_hit_t *record_hit (scan_ctx_t *ctx,
+                                      zbar_symbol_type_t type)
+{
+    scan_hit_t *hit;
+    if(ctx->nhits >= ctx->hits_alloc) {
+        ctx->hits_alloc = (ctx->hits_alloc) ? ctx->hits_alloc * 2 : 16;
+        ctx->hits = realloc(ctx->hits, ctx->hits_alloc * sizeof(scan_hit_t));
+    }
+    hit = &ctx->hits[ctx->nhits++];
+    hit->type = type;
+    return(hit);
+}
+
+static inline void record_data (scan_ctx_t *ctx,
+                                scan_hit_t *hit,
+                                const char *data,
+                                unsigned datalen)
+{
+    /* save data w/terminating NUL */
+    if(ctx->datalen + datalen + 1 > ctx->data_alloc) {
+        while(ctx->datalen + datalen + 1 > ctx->data_alloc)
+            ctx->data_alloc = (ctx->data_alloc) ? ctx->data_alloc * 2 : 256;
+        ctx->data = realloc(ctx->data, ctx->data_alloc);
+    }
+    hit->data = ctx->datalen;
+    hit->datalen = datalen;
+    memcpy(ctx->data + ctx->datalen, data, datalen + 1);
+    ctx->datalen += datalen + 1;
+}
+
+static inline void clear_hits (scan_ctx_t *ctx)
+{
+    ctx->nhits = 0;
+    ctx->datalen = 0;
+}
+
+/* note a decoder event found by the coarse pass, so nearby lines of the
+ * same direction (or both directions) are rescanned at full density
+ */
+static inline void mark_fine (zbar_image_scanner_t *iscn,
+                              int vert,
+                              int both,
+                              int x,
+                              int y)
+{
+    unsigned w = iscn->img->width, h = iscn->img->height;
+    if((!vert || both) && y >= 0 && y < h)
+        iscn->marks[y] = 1;
+    if((vert || both) && x >= 0 && x < w)
+        iscn->marks[h + x] = 1;
+}
+
 #ifdef ENABLE_QRCODE
 extern qr_finder_line *_zbar_decoder_get_qr_finder_line(zbar_decoder_t*);
 
@@ -359,65 +762,170 @@ extern qr_finder_line *_zbar_decoder_get_qr_finder_line(zbar_decoder_t*);
     ((val) >> (prec)),         \
         (1000 * ((val) & ((1 << (prec)) - 1)) / (1 << (prec)))
 
-static inline void qr_handler (zbar_image_scanner_t *iscn)
+/* finder line candidates are common in any texture, so they are only
+ * saved here and refined where crossing candidates agree
+ * (see mark_fine_finders).  a finder the coarse lines can resolve has a
+ * center run about as long as their spacing; shorter runs are ignored
+ */
+static inline void mark_fine_qr (zbar_image_scanner_t *iscn,
+                                 int vert,
+                                 const qr_finder_line *line)
+{
+    int c[2], coarse = iscn->coarse;
+    int cw = (iscn->img->width + coarse - 1) / coarse;
+    int ch = (iscn->img->height + coarse - 1) / coarse;
+    finder_cand_t *cand;
+    if(line->len * 2 < coarse << QR_FINDER_SUBPREC)
+        return;
+    c[vert] = (line->pos[vert] + (line->len >> 1)) >> QR_FINDER_SUBPREC;
+    c[!vert] = line->pos[!vert] >> QR_FINDER_SUBPREC;
+    if(c[0] < 0 || c[0] >= cw * coarse || c[1] < 0 || c[1] >= ch * coarse)
+        return;
+    cand = &iscn->cands[((c[1] / coarse) * cw + c[0] / coarse) * 2 + vert];
+    cand->x = c[0];
+    cand->y = c[1];
+    cand->len = line->len >> QR_FINDER_SUBPREC;
+}
+
+static inline void qr_handler (scan_ctx_t *ctx)
 {
     unsigned u;
     int vert;
-    qr_finder_line *line = _zbar_decoder_get_qr_finder_line(iscn->dcode);
+    qr_finder_line *line = _zbar_decoder_get_qr_finder_line(ctx->dcode);
     assert(line);
-    u = zbar_scanner_get_edge(iscn->scn, line->pos[0],
+    u = zbar_scanner_get_edge(ctx->scn, line->pos[0],
                               QR_FINDER_SUBPREC);
-    line->boffs = u - zbar_scanner_get_edge(iscn->scn, line->boffs,
+    line->boffs = u - zbar_scanner_get_edge(ctx->scn, line->boffs,
                                             QR_FINDER_SUBPREC);
-    line->len = zbar_scanner_get_edge(iscn->scn, line->len,
+    line->len = zbar_scanner_get_edge(ctx->scn, line->len,
                                       QR_FINDER_SUBPREC);
-    line->eoffs = zbar_scanner_get_edge(iscn->scn, line->eoffs,
+    line->eoffs = zbar_scanner_get_edge(ctx->scn, line->eoffs,
                                         QR_FINDER_SUBPREC) - line->len;
     line->len -= u;
 
-    u = QR_FIXED(iscn->umin, 0) + iscn->du * u;
-    if(iscn->du < 0) {
+    u = QR_FIXED(ctx->umin, 0) + ctx->du * u;
+    if(ctx->du < 0) {
         int tmp = line->boffs;
         line->boffs = line->eoffs;
         line->eoffs = tmp;
         u -= line->len;
     }
-    vert = !iscn->dx;
+    vert = !ctx->dx;
     line->pos[vert] = u;
-    line->pos[!vert] = QR_FIXED(iscn->v, 1);
+    line->pos[!vert] = QR_FIXED(ctx->v, 1);
+
+    if(ctx->record) {
+        scan_hit_t *hit = record_hit(ctx, ZBAR_QRCODE);
+        hit->vert = vert;
+        hit->line = *line;
+    }
+    else {
+        if(ctx->iscn->coarse)
+            mark_fine_qr(ctx->iscn, vert, line);
+        _zbar_qr_found_line(ctx->iscn->qr, vert, line);
+    }
+}
+#endif
+
+/* merge decoded result into current image results */
+static void add_hit (zbar_image_scanner_t *iscn,
+                     zbar_symbol_type_t type,
+                     const char *data,
+                     unsigned datalen,
+                     unsigned configs,
+                     unsigned modifiers,
+                     zbar_orientation_t orient,
+                     int x,
+                     int y)
+{
+    /* FIXME need better symbol matching */
+    zbar_symbol_t *sym = table_find(&iscn->results, type, data, datalen);
+    if(sym) {
+        sym->quality++;
+        iscn->stats.duplicates++;
+        confirm_sym(iscn, sym);
+        zprintf(224, "dup symbol @(%d,%d): dup %s: %.20s\n",
+                x, y, zbar_get_symbol_name(type), data);
+        if(TEST_CFG(iscn, ZBAR_CFG_POSITION))
+            /* extend outline to the new point */
+            _zbar_symbol_outline(sym, x, y);
+        return;
+    }
 
-    _zbar_qr_found_line(iscn->qr, vert, line);
+    sym = _zbar_image_scanner_alloc_sym(iscn, type, datalen + 1);
+    sym->configs = configs;
+    sym->modifiers = modifiers;
+    /* FIXME grab decoder buffer */
+    memcpy(sym->data, data, datalen + 1);
+
+    /* initialize first point */
+    if(TEST_CFG(iscn, ZBAR_CFG_POSITION)) {
+        zprintf(192, "new symbol @(%d,%d): %s: %.20s\n",
+                x, y, zbar_get_symbol_name(type), data);
+        sym_add_point(sym, x, y);
+    }
+
+    sym->orient = orient;
+
+    _zbar_image_scanner_add_sym(iscn, sym);
 }
+
+/* merge results recorded by a scan context, in scan order */
+static void merge_hits (zbar_image_scanner_t *iscn,
+                        const scan_ctx_t *ctx,
+                        int i0,
+                        int i1)
+{
+    int i;
+    for(i = i0; i < i1 && !iscn->satisfied; i++) {
+        const scan_hit_t *hit = &ctx->hits[i];
+#ifdef ENABLE_QRCODE
+        if(hit->type == ZBAR_QRCODE) {
+            qr_finder_line line = hit->line;
+            if(iscn->coarse)
+                mark_fine_qr(iscn, hit->vert, &line);
+            _zbar_qr_found_line(iscn->qr, hit->vert, &line);
+            continue;
+        }
 #endif
+        if(iscn->coarse)
+            mark_fine(iscn, hit->vert, 0, hit->x, hit->y);
+        if(hit->type <= ZBAR_PARTIAL)
+            continue;
+        add_hit(iscn, hit->type, ctx->data + hit->data, hit->datalen,
+                hit->configs, hit->modifiers, hit->orient, hit->x, hit->y);
+    }
+}
 
 static void symbol_handler (zbar_decoder_t *dcode)
 {
-    zbar_image_scanner_t *iscn = zbar_decoder_get_userdata(dcode);
+    scan_ctx_t *ctx = zbar_decoder_get_userdata(dcode);
+    zbar_image_scanner_t *iscn = ctx->iscn;
     zbar_symbol_type_t type = zbar_decoder_get_type(dcode);
+    zbar_orientation_t orient = ZBAR_ORIENT_UNKNOWN;
     int x = 0, y = 0, dir;
     const char *data;
     unsigned datalen;
-    zbar_symbol_t *sym;
 
 #ifdef ENABLE_QRCODE
     if(type == ZBAR_QRCODE) {
-        qr_handler(iscn);
+        qr_handler(ctx);
         return;
     }
 #else
     assert(type != ZBAR_QRCODE);
 #endif
 
-    if(TEST_CFG(iscn, ZBAR_CFG_POSITION)) {
+    if(TEST_CFG(iscn, ZBAR_CFG_POSITION) || iscn->coarse) {
         /* tmp position fixup */
-        int w = zbar_scanner_get_width(iscn->scn);
-        int u = iscn->umin + iscn->du * zbar_scanner_get_edge(iscn->scn, w, 0);
-        if(iscn->dx) {
+        int w = zbar_scanner_get_width(ctx->scn);
+        int u = ctx->umin + ctx->du * zbar_scanner_get_edge(ctx->scn, w, 0);
+        if(ctx->dx) {
             x = u;
-            y = iscn->v;
+            y = ctx->v;
         }
         else {
-            x = iscn->v;
+            x = ctx->v;
             y = u;
         }
     }
@@ -425,68 +933,118 @@ static void symbol_handler (zbar_decoder_t *dcode)
     /* FIXME debug flag to save/display all PARTIALs */
     if(type <= ZBAR_PARTIAL) {
         zprintf(256, "partial symbol @(%d,%d)\n", x, y);
+        ctx->npartials++;
+        /* partials only direct the fine pass */
+        if(!iscn->coarse)
+            return;
+        if(ctx->record) {
+            scan_hit_t *hit = record_hit(ctx, type);
+            hit->vert = !ctx->dx;
+            hit->x = x;
+            hit->y = y;
+        }
+        else
+            mark_fine(iscn, !ctx->dx, 0, x, y);
         return;
     }
 
     data = zbar_decoder_get_data(dcode);
     datalen = zbar_decoder_get_data_length(dcode);
 
-    /* FIXME need better symbol matching */
-    for(sym = iscn->syms->head; sym; sym = sym->next)
-        if(sym->type == type &&
-           sym->datalen == datalen &&
-           !memcmp(sym->data, data, datalen)) {
-            sym->quality++;
-            zprintf(224, "dup symbol @(%d,%d): dup %s: %.20s\n",
-                    x, y, zbar_get_symbol_name(type), data);
-            if(TEST_CFG(iscn, ZBAR_CFG_POSITION))
-                /* add new point to existing set */
-                /* FIXME should be polygon */
-                sym_add_point(sym, x, y);
-            return;
-        }
-
-    sym = _zbar_image_scanner_alloc_sym(iscn, type, datalen + 1);
-    sym->configs = zbar_decoder_get_configs(dcode, type);
-    sym->modifiers = zbar_decoder_get_modifiers(dcode);
-    /* FIXME grab decoder buffer */
-    memcpy(sym->data, data, datalen + 1);
-
-    /* initialize first point */
-    if(TEST_CFG(iscn, ZBAR_CFG_POSITION)) {
-        zprintf(192, "new symbol @(%d,%d): %s: %.20s\n",
-                x, y, zbar_get_symbol_name(type), data);
-        sym_add_point(sym, x, y);
-    }
-
     dir = zbar_decoder_get_direction(dcode);
     if(dir)
-        sym->orient = (iscn->dy != 0) + ((iscn->du ^ dir) & 2);
+        orient = (ctx->dy != 0) + ((ctx->du ^ dir) & 2);
+
+    if(ctx->record) {
+        scan_hit_t *hit = record_hit(ctx, type);
+        record_data(ctx, hit, data, datalen);
+        hit->configs = zbar_decoder_get_configs(dcode, type);
+        hit->modifiers = zbar_decoder_get_modifiers(dcode);
+        hit->orient = orient;
+        hit->vert = !ctx->dx;
+        hit->x = x;
+        hit->y = y;
+    }
+    else {
+        if(iscn->coarse)
+            mark_fine(iscn, !ctx->dx, 0, x, y);
+        add_hit(iscn, type, data, datalen,
+                zbar_decoder_get_configs(dcode, type),
+                zbar_decoder_get_modifiers(dcode), orient, x, y);
+    }
+}
 
-    _zbar_image_scanner_add_sym(iscn, sym);
+static int scan_ctx_init (scan_ctx_t *ctx,
+                          zbar_image_scanner_t *iscn)
+{
+    ctx->iscn = iscn;
+    ctx->dcode = zbar_decoder_create();
+    ctx->scn = zbar_scanner_create(ctx->dcode);
+    if(!ctx->dcode || !ctx->scn)
+        return(-1);
+    zbar_decoder_set_userdata(ctx->dcode, ctx);
+    zbar_decoder_set_handler(ctx->dcode, symbol_handler);
+    return(0);
 }
 
-zbar_image_scanner_t *zbar_image_scanner_create ()
+static void scan_ctx_cleanup (scan_ctx_t *ctx)
+{
+    if(ctx->scn)
+        zbar_scanner_destroy(ctx->scn);
+    ctx->scn = NULL;
+    if(ctx->dcode)
+        zbar_decoder_destroy(ctx->dcode);
+    ctx->dcode = NULL;
+    if(ctx->hits)
+        free(ctx->hits);
+    ctx->hits = NULL;
+    ctx->nhits = ctx->hits_alloc = 0;
+    if(ctx->data)
+        free(ctx->data);
+    ctx->data = NULL;
+    ctx->datalen = ctx->data_alloc = 0;
+    if(ctx->tile)
+        free(ctx->tile);
+    ctx->tile = NULL;
+    ctx->tile_alloc = 0;
+    if(ctx->elines)
+        free(ctx->elines);
+    ctx->elines = NULL;
+    ctx->nelines = ctx->elines_alloc = 0;
+}
+
+/* allocate an unconfigured scanner, sharing QR tables w/src (if any) */
+static zbar_image_scanner_t*
+image_scanner_alloc (const zbar_image_scanner_t *src)
 {
     zbar_image_scanner_t *iscn = calloc(1, sizeof(zbar_image_scanner_t));
     if(!iscn)
         return(NULL);
-    iscn->dcode = zbar_decoder_create();
-    iscn->scn = zbar_scanner_create(iscn->dcode);
-    if(!iscn->dcode || !iscn->scn) {
+#ifdef HAVE_THREADS
+    _zbar_mutex_init(&iscn->mutex);
+    _zbar_event_init(&iscn->done);
+#endif
+    if(scan_ctx_init(&iscn->ctx, iscn)) {
         zbar_image_scanner_destroy(iscn);
         return(NULL);
     }
-    zbar_decoder_set_userdata(iscn->dcode, iscn);
-    zbar_decoder_set_handler(iscn->dcode, symbol_handler);
 
 #ifdef ENABLE_QRCODE
-    iscn->qr = _zbar_qr_create();
+    iscn->qr = (src && src->qr) ? _zbar_qr_clone(src->qr) : _zbar_qr_create();
 #endif
+    return(iscn);
+}
+
+zbar_image_scanner_t *zbar_image_scanner_create ()
+{
+    zbar_image_scanner_t *iscn = image_scanner_alloc(NULL);
+    if(!iscn)
+        return(NULL);
 
     /* apply default configuration */
     CFG(iscn, ZBAR_CFG_X_DENSITY) = 1;
     CFG(iscn, ZBAR_CFG_Y_DENSITY) = 1;
+    CFG(iscn, ZBAR_CFG_SKIP_INTERVAL) = 30;
     zbar_image_scanner_set_config(iscn, 0, ZBAR_CFG_POSITION, 1);
     zbar_image_scanner_set_config(iscn, 0, ZBAR_CFG_UNCERTAINTY, 2);
     zbar_image_scanner_set_config(iscn, ZBAR_QRCODE, ZBAR_CFG_UNCERTAINTY, 0);
@@ -498,6 +1056,34 @@ zbar_image_scanner_t *zbar_image_scanner_create ()
     return(iscn);
 }
 
+extern void _zbar_decoder_copy_config(zbar_decoder_t*, const zbar_decoder_t*);
+
+zbar_image_scanner_t *zbar_image_scanner_clone (const zbar_image_scanner_t *src)
+{
+    zbar_image_scanner_t *iscn = image_scanner_alloc(src);
+    if(!iscn)
+        return(NULL);
+
+    /* copy configuration, but no scan state or results */
+    _zbar_decoder_copy_config(iscn->ctx.dcode, src->ctx.dcode);
+    iscn->config = src->config;
+    iscn->ean_config = src->ean_config;
+    memcpy(iscn->configs, src->configs, sizeof(iscn->configs));
+    memcpy(iscn->sym_configs, src->sym_configs, sizeof(iscn->sym_configs));
+    iscn->deadline_us = src->deadline_us;
+    iscn->enable_cache = src->enable_cache;
+    iscn->enable_stats = src->enable_stats;
+    iscn->handler = src->handler;
+    iscn->userdata = src->userdata;
+#ifdef HAVE_THREADS
+    if(zbar_image_scanner_set_threads(iscn, src->nworkers + 1)) {
+        zbar_image_scanner_destroy(iscn);
+        return(NULL);
+    }
+#endif
+    return(iscn);
+}
+
 #ifndef NO_STATS
 static inline void dump_stats (const zbar_image_scanner_t *iscn)
 {
@@ -518,6 +1104,7 @@ void zbar_image_scanner_destroy (zbar_image_scanner_t *iscn)
 {
     int i;
     dump_stats(iscn);
+    zbar_image_scanner_set_threads(iscn, 1);
     if(iscn->syms) {
         if(iscn->syms->refcnt)
             zbar_symbol_set_ref(iscn->syms, -1);
@@ -525,12 +1112,16 @@ void zbar_image_scanner_destroy (zbar_image_scanner_t *iscn)
             _zbar_symbol_set_free(iscn->syms);
         iscn->syms = NULL;
     }
-    if(iscn->scn)
-        zbar_scanner_destroy(iscn->scn);
-    iscn->scn = NULL;
-    if(iscn->dcode)
-        zbar_decoder_destroy(iscn->dcode);
-    iscn->dcode = NULL;
+    scan_ctx_cleanup(&iscn->ctx);
+    if(iscn->marks)
+        free(iscn->marks);
+    if(iscn->lines)
+        free(iscn->lines);
+    if(iscn->cands)
+        free(iscn->cands);
+    cache_flush(iscn);
+    table_free(&iscn->cache_index);
+    table_free(&iscn->results);
     for(i = 0; i < RECYCLE_BUCKETS; i++) {
         zbar_symbol_t *sym, *next;
         for(sym = iscn->recycle[i].head; sym; sym = next) {
@@ -543,6 +1134,10 @@ void zbar_image_scanner_destroy (zbar_image_scanner_t *iscn)
         _zbar_qr_destroy(iscn->qr);
         iscn->qr = NULL;
     }
+#endif
+#ifdef HAVE_THREADS
+    _zbar_event_destroy(&iscn->done);
+    _zbar_mutex_destroy(&iscn->mutex);
 #endif
     free(iscn);
 }
@@ -563,6 +1158,9 @@ int zbar_image_scanner_set_config (zbar_image_scanner_t *iscn,
                                    zbar_config_t cfg,
                                    int val)
 {
+    /* rescan even an unchanged image with the new config */
+    iscn->sig_w = 0;
+
     if((sym == 0 || sym == ZBAR_COMPOSITE) && cfg == ZBAR_CFG_ENABLE) {
         iscn->ean_config = !!val;
         if(sym)
@@ -570,11 +1168,11 @@ int zbar_image_scanner_set_config (zbar_image_scanner_t *iscn,
     }
 
     if(cfg < ZBAR_CFG_UNCERTAINTY)
-        return(zbar_decoder_set_config(iscn->dcode, sym, cfg, val));
+        return(zbar_decoder_set_config(iscn->ctx.dcode, sym, cfg, val));
 
     if(cfg < ZBAR_CFG_POSITION) {
         int c, i;
-        if(cfg > ZBAR_CFG_UNCERTAINTY)
+        if(cfg > ZBAR_CFG_STOP_AFTER)
             return(1);
         c = cfg - ZBAR_CFG_UNCERTAINTY;
         if(sym > ZBAR_PARTIAL) {
@@ -590,12 +1188,12 @@ int zbar_image_scanner_set_config (zbar_image_scanner_t *iscn,
     if(sym > ZBAR_PARTIAL)
         return(1);
 
-    if(cfg >= ZBAR_CFG_X_DENSITY && cfg <= ZBAR_CFG_Y_DENSITY) {
+    if(cfg >= ZBAR_CFG_X_DENSITY && cfg <= ZBAR_CFG_MAX_RESULTS) {
         CFG(iscn, cfg) = val;
         return(0);
     }
 
-    if(cfg > ZBAR_CFG_POSITION)
+    if(cfg > ZBAR_CFG_EDGE_LIST)
         return(1);
     cfg -= ZBAR_CFG_POSITION;
 
@@ -612,12 +1210,42 @@ int zbar_image_scanner_set_config (zbar_image_scanner_t *iscn,
 void zbar_image_scanner_enable_cache (zbar_image_scanner_t *iscn,
                                       int enable)
 {
-    if(iscn->cache) {
-        /* recycle all cached syms */
-        _zbar_image_scanner_recycle_syms(iscn, iscn->cache);
-        iscn->cache = NULL;
-    }
+    /* recycle all cached syms */
+    cache_flush(iscn);
     iscn->enable_cache = (enable) ? 1 : 0;
+    iscn->track_frames = 0;
+    iscn->sig_w = 0;
+}
+
+void zbar_image_scanner_enable_stats (zbar_image_scanner_t *iscn,
+                                      int enable)
+{
+    iscn->enable_stats = (enable) ? 1 : 0;
+    memset(&iscn->stats, 0, sizeof(iscn->stats));
+}
+
+int zbar_image_scanner_get_stats (const zbar_image_scanner_t *iscn,
+                                  zbar_scan_stats_t *stats)
+{
+    if(!iscn->enable_stats) {
+        memset(stats, 0, sizeof(*stats));
+        return(1);
+    }
+    *stats = iscn->stats;
+    return(0);
+}
+
+void _zbar_image_scanner_lap (zbar_image_scanner_t *iscn,
+                              scan_stage_t stage,
+                              unsigned long *lap)
+{
+    unsigned long now;
+    if(!iscn->enable_stats)
+        return;
+    now = _zbar_timer_now_us();
+    if(stage != SCAN_STAGE_START)
+        iscn->times[stage] += now - *lap;
+    *lap = now;
 }
 
 const zbar_symbol_set_t *
@@ -626,44 +1254,932 @@ zbar_image_scanner_get_results (const zbar_image_scanner_t *iscn)
     return(iscn->syms);
 }
 
-static inline void quiet_border (zbar_image_scanner_t *iscn)
+static inline void quiet_border (scan_ctx_t *ctx)
 {
     /* flush scanner pipeline */
-    zbar_scanner_t *scn = iscn->scn;
+    zbar_scanner_t *scn = ctx->scn;
     zbar_scanner_flush(scn);
     zbar_scanner_flush(scn);
     zbar_scanner_new_scan(scn);
 }
 
-#define movedelta(dx, dy) do {                  \
-        x += (dx);                              \
-        y += (dy);                              \
-        p += (dx) + ((uintptr_t)(dy) * w);       \
-    } while(0);
-
-int zbar_scan_image (zbar_image_scanner_t *iscn,
-                     zbar_image_t *img)
+/* locate scan lines spaced by density across the crop range,
+ * centering any remainder
+ */
+static inline void setup_pass (scan_pass_t *pass,
+                               const zbar_image_t *img,
+                               int vert,
+                               int density)
 {
-    zbar_symbol_set_t *syms;
-    const uint8_t *data;
-    zbar_scanner_t *scn = iscn->scn;
-    unsigned w, h, cx1, cy1;
-    int density;
-
-    /* timestamp image
-     * FIXME prefer video timestamp
-     */
-    iscn->time = _zbar_timer_now();
+    int border;
+    unsigned crop0 = (vert) ? img->crop_x : img->crop_y;
+    unsigned cropn = (vert) ? img->crop_w : img->crop_h;
+    unsigned end = crop0 + cropn;
+    pass->density = density;
+    pass->nlines = 0;
+    pass->lines = NULL;
+    pass->u0 = (vert) ? img->crop_y : img->crop_x;
+    pass->un = (vert) ? img->crop_h : img->crop_w;
+    if(density <= 0)
+        return;
 
-#ifdef ENABLE_QRCODE
-    _zbar_qr_reset(iscn->qr);
-#endif
+    border = (((cropn - 1) % density) + 1) / 2;
+    if(border > cropn / 2)
+        border = cropn / 2;
+    border += crop0;
+    pass->border = border;
+    if(border < end)
+        pass->nlines = (end - border + density - 1) / density;
+}
 
-    /* image must be in grayscale format */
-    if(img->format != fourcc('Y','8','0','0') &&
-       img->format != fourcc('G','R','E','Y'))
-        return(-1);
-    iscn->img = img;
+/* copy vertical lines [k0, k0 + nk) of a pass into consecutive rows of
+ * the tile buffer, reading the image sequentially a row at a time
+ * instead of striding down each column
+ */
+static const uint8_t *load_tile (scan_ctx_t *ctx,
+                                 const zbar_image_t *img,
+                                 const scan_pass_t *pass,
+                                 int k0,
+                                 int nk)
+{
+    const zbar_image_scanner_t *iscn = ctx->iscn;
+    unsigned n = pass->un, size = nk * n, y;
+    intptr_t w = iscn->luma_stride;
+    intptr_t density = pass->density * iscn->luma_step;
+    const uint8_t *row = iscn->luma + pass->u0 * w;
+
+    if(ctx->tile_alloc < size) {
+        if(ctx->tile)
+            free(ctx->tile);
+        ctx->tile = malloc(size);
+        ctx->tile_alloc = (ctx->tile) ? size : 0;
+        if(!ctx->tile)
+            return(NULL);
+    }
+
+    if(pass->lines) {
+        const int *lines = pass->lines + k0;
+        intptr_t step = iscn->luma_step;
+        for(y = 0; y < n; y++, row += w) {
+            uint8_t *dst = ctx->tile + y;
+            int j;
+            for(j = 0; j < nk; j++, dst += n)
+                *dst = row[lines[j] * step];
+        }
+        return(ctx->tile);
+    }
+
+    row += (pass->border + k0 * pass->density) * iscn->luma_step;
+    for(y = 0; y < n; y++, row += w) {
+        const uint8_t *src = row;
+        uint8_t *dst = ctx->tile + y;
+        int j;
+        for(j = 0; j < nk; j++, src += density, dst += n)
+            *dst = *src;
+    }
+    return(ctx->tile);
+}
+
+/* check the scan deadline (each thread checks for itself)
+ * and whether the requested results were already found
+ */
+static inline int scan_stopped (scan_ctx_t *ctx)
+{
+    if(!ctx->timeout && ctx->iscn->deadline_us &&
+       _zbar_timer_expired(&ctx->iscn->deadline))
+        ctx->timeout = 1;
+    return(ctx->timeout || ctx->iscn->satisfied);
+}
+
+int _zbar_image_scanner_stopped (zbar_image_scanner_t *iscn)
+{
+    return(scan_stopped(&iscn->ctx));
+}
+
+/* decode lines [l0, l1) recorded by src using the scanner of ctx */
+static void decode_lines (scan_ctx_t *ctx,
+                          const scan_ctx_t *src,
+                          int l0,
+                          int l1)
+{
+    const zbar_edge_t *edges = zbar_scanner_get_edges(src->scn, NULL);
+    int l;
+    for(l = l0; l < l1 && !scan_stopped(ctx); l++) {
+        const edge_line_t *line = &src->elines[l];
+        ctx->v = line->v;
+        ctx->du = line->du;
+        ctx->umin = line->umin;
+        ctx->dx = (line->vert) ? 0 : line->du;
+        ctx->dy = (line->vert) ? line->du : 0;
+        zbar_scanner_decode_edges(ctx->scn, edges + line->e0, line->ne);
+        zbar_decoder_new_scan(ctx->dcode);
+    }
+}
+
+static inline edge_line_t *add_edge_line (scan_ctx_t *ctx,
+                                          int vert)
+{
+    edge_line_t *line;
+    if(ctx->nelines >= ctx->elines_alloc) {
+        ctx->elines_alloc = (ctx->elines_alloc) ? ctx->elines_alloc * 2 : 64;
+        ctx->elines = realloc(ctx->elines,
+                              ctx->elines_alloc * sizeof(edge_line_t));
+    }
+    line = &ctx->elines[ctx->nelines++];
+    line->seg = ctx->iscn->nsegs + vert;
+    line->vert = vert;
+    line->v = ctx->v;
+    line->du = ctx->du;
+    line->umin = ctx->umin;
+    zbar_scanner_get_edges(ctx->scn, &line->e0);
+    return(line);
+}
+
+/* scan lines [k0, k1) of a pass, alternating direction as a
+ * serpentine walk of the whole pass would.
+ * a two-phase pass extracts the edges of every line before decoding
+ */
+static void scan_lines (scan_ctx_t *ctx,
+                        const zbar_image_t *img,
+                        const scan_pass_t *pass,
+                        int vert,
+                        int k0,
+                        int k1)
+{
+    const zbar_image_scanner_t *iscn = ctx->iscn;
+    const uint8_t *data = iscn->luma, *tile = NULL;
+    int u0 = pass->u0, n = pass->un;
+    /* sample step along and across scan lines */
+    intptr_t su = (vert) ? iscn->luma_stride : iscn->luma_step;
+    intptr_t sv = (vert) ? iscn->luma_step : iscn->luma_stride;
+    int k, tk = k1, l0 = ctx->nelines;
+    int two_phase = TEST_CFG(iscn, ZBAR_CFG_EDGE_LIST);
+    unsigned long t0 = (iscn->enable_stats) ? _zbar_timer_now_us() : 0;
+
+    zbar_scanner_record_edges(ctx->scn, two_phase);
+    ctx->dx = ctx->dy = 0;
+    for(k = k0; k < k1 && !scan_stopped(ctx); k++) {
+        int v = (pass->lines) ? pass->lines[k]
+                              : pass->border + k * pass->density;
+        int fwd = !(k & 1);
+        ctx->v = v;
+        ctx->du = (fwd) ? 1 : -1;
+        ctx->umin = (fwd) ? u0 : u0 + n;
+        if(vert)
+            ctx->dy = ctx->du;
+        else
+            ctx->dx = ctx->du;
+
+        zprintf(128, "img_%c%c: %04d @%04d\n",
+                (vert) ? 'y' : 'x', (fwd) ? '+' : '-', v, ctx->umin);
+        if(two_phase)
+            add_edge_line(ctx, vert);
+        svg_path_start("vedge", ctx->du / 32.,
+                       (fwd) ? 0 : (vert) ? img->height : img->width, v + 0.5);
+        if(n > 0) {
+            const uint8_t *p;
+            intptr_t stride = su;
+            if(vert && (k - k0) % TILE_LINES == 0) {
+                int nk = (k1 - k < TILE_LINES) ? k1 - k : TILE_LINES;
+                tile = load_tile(ctx, img, pass, k, nk);
+                tk = k;
+            }
+            if(vert && tile) {
+                p = tile + (k - tk) * n;
+                stride = 1;
+            }
+            else
+                p = data + v * sv + u0 * su;
+            if(!fwd) {
+                p += (n - 1) * stride;
+                stride = -stride;
+            }
+            zbar_scanner_scan_line(ctx->scn, p, n, stride);
+        }
+        quiet_border(ctx);
+        if(two_phase) {
+            edge_line_t *line = &ctx->elines[ctx->nelines - 1];
+            zbar_scanner_get_edges(ctx->scn, &line->ne);
+            line->ne -= line->e0;
+        }
+        svg_path_end();
+    }
+
+    if(two_phase) {
+        zbar_scanner_record_edges(ctx->scn, 0);
+        decode_lines(ctx, ctx, l0, ctx->nelines);
+    }
+    if(iscn->enable_stats)
+        ctx->time[vert] += _zbar_timer_now_us() - t0;
+}
+
+#ifdef HAVE_THREADS
+static ZTHREAD scan_thread (void *arg)
+{
+    scan_worker_t *wkr = arg;
+    zbar_image_scanner_t *iscn = wkr->ctx.iscn;
+    zbar_thread_t *thread = &wkr->thread;
+
+    _zbar_mutex_lock(&iscn->mutex);
+    _zbar_thread_init(thread);
+
+    while(thread->started) {
+        /* wait for band assignment */
+        while(thread->started && !wkr->busy)
+            _zbar_event_wait(&thread->notify, &iscn->mutex, NULL);
+        if(!thread->started)
+            break;
+
+        _zbar_mutex_unlock(&iscn->mutex);
+        scan_lines(&wkr->ctx, iscn->img, &iscn->pass[0], 0,
+                   wkr->k0[0], wkr->k1[0]);
+        wkr->nhits0 = wkr->ctx.nhits;
+        scan_lines(&wkr->ctx, iscn->img, &iscn->pass[1], 1,
+                   wkr->k0[1], wkr->k1[1]);
+        _zbar_mutex_lock(&iscn->mutex);
+
+        wkr->busy = 0;
+        if(!--iscn->nbusy)
+            _zbar_event_trigger(&iscn->done);
+    }
+
+    thread->running = 0;
+    _zbar_event_trigger(&thread->activity);
+    _zbar_mutex_unlock(&iscn->mutex);
+    return(0);
+}
+
+/* split each pass into contiguous bands of lines scanned concurrently,
+ * then merge results in the same order a single thread would find them
+ */
+static void scan_threaded (zbar_image_scanner_t *iscn,
+                           zbar_image_t *img)
+{
+    scan_ctx_t *ctx = &iscn->ctx;
+    int i, nthr = iscn->nworkers + 1, nhits0;
+
+    _zbar_mutex_lock(&iscn->mutex);
+    for(i = 0; i < iscn->nworkers; i++) {
+        scan_worker_t *wkr = &iscn->workers[i];
+        int pass;
+        for(pass = 0; pass < 2; pass++) {
+            int n = iscn->pass[pass].nlines;
+            wkr->k0[pass] = n * (i + 1) / nthr;
+            wkr->k1[pass] = n * (i + 2) / nthr;
+        }
+        /* pick up any configuration changes */
+        _zbar_decoder_copy_config(wkr->ctx.dcode, ctx->dcode);
+        clear_hits(&wkr->ctx);
+        wkr->busy = 1;
+        iscn->nbusy++;
+        _zbar_event_trigger(&wkr->thread.notify);
+    }
+    _zbar_mutex_unlock(&iscn->mutex);
+
+    /* first band is scanned by calling thread */
+    ctx->record = 1;
+    clear_hits(ctx);
+    scan_lines(ctx, img, &iscn->pass[0], 0, 0, iscn->pass[0].nlines / nthr);
+    nhits0 = ctx->nhits;
+    scan_lines(ctx, img, &iscn->pass[1], 1, 0, iscn->pass[1].nlines / nthr);
+    ctx->record = 0;
+
+    _zbar_mutex_lock(&iscn->mutex);
+    while(iscn->nbusy)
+        _zbar_event_wait(&iscn->done, &iscn->mutex, NULL);
+    _zbar_mutex_unlock(&iscn->mutex);
+
+    merge_hits(iscn, ctx, 0, nhits0);
+    for(i = 0; i < iscn->nworkers; i++)
+        merge_hits(iscn, &iscn->workers[i].ctx, 0, iscn->workers[i].nhits0);
+    merge_hits(iscn, ctx, nhits0, ctx->nhits);
+    for(i = 0; i < iscn->nworkers; i++)
+        merge_hits(iscn, &iscn->workers[i].ctx, iscn->workers[i].nhits0,
+                   iscn->workers[i].ctx.nhits);
+}
+#endif
+
+void zbar_image_scanner_set_deadline (zbar_image_scanner_t *iscn,
+                                      unsigned long usec)
+{
+    iscn->deadline_us = usec;
+}
+
+#ifdef HAVE_THREADS
+/* shutdown started threads and release all workers */
+static void stop_workers (zbar_image_scanner_t *iscn)
+{
+    int i;
+    _zbar_mutex_lock(&iscn->mutex);
+    for(i = 0; i < iscn->nworkers; i++)
+        _zbar_thread_stop(&iscn->workers[i].thread, &iscn->mutex);
+    _zbar_mutex_unlock(&iscn->mutex);
+    for(i = 0; i < iscn->nworkers; i++)
+        scan_ctx_cleanup(&iscn->workers[i].ctx);
+    free(iscn->workers);
+    iscn->workers = NULL;
+    iscn->nworkers = 0;
+}
+#endif
+
+int zbar_image_scanner_set_threads (zbar_image_scanner_t *iscn,
+                                    int nthreads)
+{
+#ifdef HAVE_THREADS
+    int i;
+    if(nthreads < 1 || nthreads > MAX_THREADS)
+        return(1);
+    if(nthreads == iscn->nworkers + 1)
+        return(0);
+    /* edges kept by current threads are lost */
+    iscn->nsegs = 0;
+
+    if(iscn->workers)
+        stop_workers(iscn);
+    if(nthreads == 1)
+        return(0);
+
+    iscn->workers = calloc(nthreads - 1, sizeof(scan_worker_t));
+    if(!iscn->workers)
+        return(1);
+    for(i = 0; i < nthreads - 1; i++) {
+        scan_worker_t *wkr = &iscn->workers[i];
+        if(scan_ctx_init(&wkr->ctx, iscn) ||
+           _zbar_thread_start(&wkr->thread, scan_thread, wkr,
+                              &iscn->mutex)) {
+            /* only the first nworkers were started */
+            scan_ctx_cleanup(&wkr->ctx);
+            stop_workers(iscn);
+            return(1);
+        }
+        wkr->ctx.record = 1;
+        iscn->nworkers++;
+    }
+    return(0);
+#else
+    return(nthreads != 1);
+#endif
+}
+
+/* scan both passes of the current geometry */
+static void scan_passes (zbar_image_scanner_t *iscn,
+                         zbar_image_t *img)
+{
+#ifdef HAVE_THREADS
+    if(iscn->nworkers)
+        scan_threaded(iscn, img);
+    else
+#endif
+    {
+        svg_group_start("scanner", 0, 1, 1, 0, 0);
+        scan_lines(&iscn->ctx, img, &iscn->pass[0], 0,
+                   0, iscn->pass[0].nlines);
+        svg_group_end();
+
+        svg_group_start("scanner", 90, 1, -1, 0, 0);
+        scan_lines(&iscn->ctx, img, &iscn->pass[1], 1,
+                   0, iscn->pass[1].nlines);
+        svg_group_end();
+    }
+    if(TEST_CFG(iscn, ZBAR_CFG_EDGE_LIST))
+        iscn->nsegs += 2;
+}
+
+static inline scan_ctx_t *get_ctx (zbar_image_scanner_t *iscn,
+                                   int i)
+{
+#ifdef HAVE_THREADS
+    if(i)
+        return(&iscn->workers[i - 1].ctx);
+#endif
+    return(&iscn->ctx);
+}
+
+/* any thread stopped at the deadline? */
+static int scan_truncated (zbar_image_scanner_t *iscn)
+{
+    int i, nctx = 1;
+#ifdef HAVE_THREADS
+    nctx += iscn->nworkers;
+#endif
+    for(i = 0; i < nctx; i++)
+        if(get_ctx(iscn, i)->timeout)
+            return(1);
+    return(0);
+}
+
+extern unsigned long _zbar_scanner_take_located(zbar_scanner_t*);
+extern unsigned long _zbar_decoder_take_widths(zbar_decoder_t*, unsigned*);
+
+/* add (sign 1) or subtract (sign -1) the symbol allocation counters */
+static void stats_allocs (const zbar_image_scanner_t *iscn,
+                          zbar_scan_stats_t *stats,
+                          int sign)
+{
+#ifndef NO_STATS
+    int i;
+    stats->syms_new += sign * iscn->stat_sym_new;
+    stats->sets_new += sign * iscn->stat_syms_new;
+    for(i = 0; i < RECYCLE_BUCKETS; i++)
+        stats->syms_recycled += sign * iscn->stat_sym_recycle[i];
+#endif
+}
+
+/* reset statistics for a new image */
+static void stats_begin (zbar_image_scanner_t *iscn)
+{
+    int i, nctx = 1;
+#ifdef HAVE_THREADS
+    nctx += iscn->nworkers;
+#endif
+    memset(&iscn->stats, 0, sizeof(iscn->stats));
+    memset(iscn->times, 0, sizeof(iscn->times));
+    stats_allocs(iscn, &iscn->stats, -1);
+    for(i = 0; i < nctx; i++) {
+        scan_ctx_t *ctx = get_ctx(iscn, i);
+        _zbar_scanner_take_located(ctx->scn);
+        _zbar_decoder_take_widths(ctx->dcode, NULL);
+        ctx->time[0] = ctx->time[1] = 0;
+        ctx->npartials = 0;
+    }
+}
+
+/* collect statistics of a finished image from every thread */
+static void stats_end (zbar_image_scanner_t *iscn)
+{
+    zbar_scan_stats_t *stats = &iscn->stats;
+    int i, nctx = 1;
+#ifdef HAVE_THREADS
+    nctx += iscn->nworkers;
+#endif
+    for(i = 0; i < nctx; i++) {
+        scan_ctx_t *ctx = get_ctx(iscn, i);
+        stats->edges += _zbar_scanner_take_located(ctx->scn);
+        stats->widths += _zbar_decoder_take_widths(ctx->dcode,
+                                                   &stats->decoders);
+        stats->partials += ctx->npartials;
+        iscn->times[SCAN_STAGE_X] += ctx->time[0];
+        iscn->times[SCAN_STAGE_Y] += ctx->time[1];
+    }
+    stats_allocs(iscn, stats, 1);
+    stats->time_x = iscn->times[SCAN_STAGE_X];
+    stats->time_y = iscn->times[SCAN_STAGE_Y];
+    stats->time_qr_locate = iscn->times[SCAN_STAGE_QR_LOCATE];
+    stats->time_qr_binarize = iscn->times[SCAN_STAGE_QR_BINARIZE];
+    stats->time_qr_decode = iscn->times[SCAN_STAGE_QR_DECODE];
+    stats->time_filter = iscn->times[SCAN_STAGE_FILTER];
+}
+
+/* discard edges kept from the previous image */
+static void clear_edges (zbar_image_scanner_t *iscn)
+{
+    int i, nctx = 1;
+#ifdef HAVE_THREADS
+    nctx += iscn->nworkers;
+#endif
+    for(i = 0; i < nctx; i++) {
+        scan_ctx_t *ctx = get_ctx(iscn, i);
+        zbar_scanner_clear_edges(ctx->scn);
+        ctx->nelines = 0;
+    }
+    iscn->nsegs = 0;
+}
+
+/* decode all kept edges with the calling thread, in the order the
+ * threads' results were originally merged (see scan_threaded)
+ */
+static void redecode_lines (zbar_image_scanner_t *iscn)
+{
+    int seg, i, nctx = 1, l[MAX_THREADS];
+    unsigned long lap = 0;
+#ifdef HAVE_THREADS
+    nctx += iscn->nworkers;
+#endif
+    memset(l, 0, sizeof(l));
+    _zbar_image_scanner_lap(iscn, SCAN_STAGE_START, &lap);
+    for(seg = 0; seg < iscn->nsegs; seg++) {
+        for(i = 0; i < nctx; i++) {
+            const scan_ctx_t *src = get_ctx(iscn, i);
+            int l1 = l[i];
+            while(l1 < src->nelines && src->elines[l1].seg == seg)
+                l1++;
+            decode_lines(&iscn->ctx, src, l[i], l1);
+            l[i] = l1;
+        }
+        /* odd passes are vertical (see scan_passes) */
+        _zbar_image_scanner_lap(iscn, (seg & 1) ? SCAN_STAGE_Y : SCAN_STAGE_X,
+                                &lap);
+    }
+}
+
+/* allocate and clear line marks for an image */
+static int alloc_marks (zbar_image_scanner_t *iscn,
+                        const zbar_image_t *img)
+{
+    unsigned len = img->width + img->height;
+    if(iscn->marks_alloc < len) {
+        if(iscn->marks)
+            free(iscn->marks);
+        iscn->marks = malloc(len);
+        iscn->marks_alloc = (iscn->marks) ? len : 0;
+        if(!iscn->marks)
+            return(0);
+    }
+    if(iscn->lines_alloc < len) {
+        if(iscn->lines)
+            free(iscn->lines);
+        iscn->lines = malloc(len * sizeof(int));
+        iscn->lines_alloc = (iscn->lines) ? len : 0;
+        if(!iscn->lines)
+            return(0);
+    }
+    memset(iscn->marks, 0, len);
+    return(1);
+}
+
+/* space passes that will be refined at the coarse density.
+ * returns the coarse density, or 0 if there is nothing to refine
+ */
+static int coarse_setup (zbar_image_scanner_t *iscn,
+                         const zbar_image_t *img)
+{
+    int coarse = CFG(iscn, ZBAR_CFG_COARSE_DENSITY), i, n = 0;
+    unsigned ncands = ((img->width + coarse - 1) / coarse) *
+        ((img->height + coarse - 1) / coarse) * 2;
+
+    for(i = 0; i < 2; i++)
+        if(iscn->pass[i].density > 0 && coarse > iscn->pass[i].density)
+            n++;
+    if(!n || !alloc_marks(iscn, img))
+        return(0);
+
+    if(iscn->cands_alloc < ncands) {
+        if(iscn->cands)
+            free(iscn->cands);
+        iscn->cands = malloc(ncands * sizeof(finder_cand_t));
+        iscn->cands_alloc = (iscn->cands) ? ncands : 0;
+        if(!iscn->cands)
+            return(0);
+    }
+    memset(iscn->cands, 0, ncands * sizeof(finder_cand_t));
+
+    for(i = 0; i < 2; i++) {
+        scan_pass_t *pass = &iscn->pass[i];
+        iscn->fine_density[i] = 0;
+        if(pass->density > 0 && coarse > pass->density) {
+            iscn->fine_density[i] = pass->density;
+            setup_pass(pass, img, i, coarse);
+        }
+    }
+    return(coarse);
+}
+
+/* mark rows and columns around finder candidates crossed by a candidate
+ * of similar size from the other direction near its center
+ */
+static void mark_fine_finders (zbar_image_scanner_t *iscn,
+                               const zbar_image_t *img,
+                               int coarse)
+{
+    int cw = (img->width + coarse - 1) / coarse;
+    int ch = (img->height + coarse - 1) / coarse;
+    int cx, cy;
+    for(cy = 0; cy < ch; cy++)
+        for(cx = 0; cx < cw; cx++) {
+            const finder_cand_t *h = &iscn->cands[(cy * cw + cx) * 2];
+            int x, y;
+            if(!h->len)
+                continue;
+            for(y = cy - 1; y <= cy + 1; y++)
+                for(x = cx - 1; x <= cx + 1; x++) {
+                    const finder_cand_t *v;
+                    int tol;
+                    if(x < 0 || x >= cw || y < 0 || y >= ch)
+                        continue;
+                    v = &iscn->cands[(y * cw + x) * 2 + 1];
+                    if(!v->len || v->len > h->len * 2 || h->len > v->len * 2)
+                        continue;
+                    tol = ((h->len > v->len) ? h->len : v->len) / 2;
+                    if(abs(v->x - h->x) <= tol && abs(h->y - v->y) <= tol)
+                        mark_fine(iscn, 0, 1, h->x, v->y);
+                }
+        }
+}
+
+/* replace each pass with the fine lines within reach of a mark,
+ * skipping lines already scanned by a coarse pass (if any).
+ * returns the total number of lines
+ */
+static int setup_marked (zbar_image_scanner_t *iscn,
+                         const zbar_image_t *img,
+                         int coarse)
+{
+    int *lines = iscn->lines, i, n = 0;
+    int reach = (coarse) ? coarse : 1;
+
+    for(i = 0; i < 2; i++) {
+        scan_pass_t *pass = &iscn->pass[i], fine;
+        int cborder = pass->border, k;
+        int crop0 = (i) ? img->crop_x : img->crop_y;
+        int crop1 = crop0 + ((i) ? img->crop_w : img->crop_h);
+        const uint8_t *marks = iscn->marks + ((i) ? img->height : 0);
+
+        if(!iscn->fine_density[i]) {
+            /* disabled, or already scanned at full density */
+            pass->nlines = 0;
+            continue;
+        }
+        setup_pass(&fine, img, i, iscn->fine_density[i]);
+        *pass = fine;
+        pass->lines = lines;
+        pass->nlines = 0;
+        for(k = 0; k < fine.nlines; k++) {
+            int v = fine.border + k * fine.density, d;
+            if(coarse && v >= cborder && !((v - cborder) % coarse))
+                continue;
+            for(d = 1 - reach; d < reach; d++)
+                if(v + d >= crop0 && v + d < crop1 && marks[v + d])
+                    break;
+            if(d < reach)
+                lines[pass->nlines++] = v;
+        }
+        lines += pass->nlines;
+        n += pass->nlines;
+    }
+    return(n);
+}
+
+/* replace each coarse pass with the fine lines near marked events */
+static inline int fine_setup (zbar_image_scanner_t *iscn,
+                              const zbar_image_t *img,
+                              int coarse)
+{
+    mark_fine_finders(iscn, img, coarse);
+    return(setup_marked(iscn, img, coarse));
+}
+
+/* mark the lines crossing the predicted region of a tracked entry,
+ * extending the span of each direction to cover it
+ */
+static void track_mark (zbar_image_scanner_t *iscn,
+                        const zbar_image_t *img,
+                        const zbar_symbol_t *entry,
+                        int span[2][2])
+{
+    const point_t *p = entry->pts;
+    int x0, y0, x1, y1, dx, dy, m, v, dirs = 3;
+
+    /* predict constant motion since the previous sighting */
+    dx = (p[0].x + p[1].x - p[2].x - p[3].x) / 2;
+    dy = (p[0].y + p[1].y - p[2].y - p[3].y) / 2;
+    /* allow for scale changes and prediction error */
+    m = (p[1].x - p[0].x > p[1].y - p[0].y)
+        ? p[1].x - p[0].x : p[1].y - p[0].y;
+    m = m / 8 + TRACK_MARGIN;
+    x0 = p[0].x + dx - m - abs(dx);
+    x1 = p[1].x + dx + m + abs(dx);
+    y0 = p[0].y + dy - m - abs(dy);
+    y1 = p[1].y + dy + m + abs(dy);
+    /* linear symbols only need the direction that decoded them */
+    if(entry->type != ZBAR_QRCODE && entry->orient != ZBAR_ORIENT_UNKNOWN)
+        dirs = (entry->orient & 1) ? 2 : 1;
+    if(dirs & 1) {
+        for(v = (y0 > 0) ? y0 : 0; v <= y1 && v < img->height; v++)
+            iscn->marks[v] = 1;
+        if(span[0][0] > x0) span[0][0] = x0;
+        if(span[0][1] < x1) span[0][1] = x1;
+    }
+    if(dirs & 2) {
+        for(v = (x0 > 0) ? x0 : 0; v <= x1 && v < img->width; v++)
+            iscn->marks[img->height + v] = 1;
+        if(span[1][0] > y0) span[1][0] = y0;
+        if(span[1][1] < y1) span[1][1] = y1;
+    }
+}
+
+/* restrict passes to the predicted regions of tracked cache entries:
+ * only lines crossing a region are scanned, and only across the
+ * combined extent of the regions.
+ * returns the number of lines, or 0 if nothing is tracked
+ */
+static int track_setup (zbar_image_scanner_t *iscn,
+                        const zbar_image_t *img)
+{
+    zbar_symbol_t *entry;
+    int span[2][2] = { { img->width, -1 }, { img->height, -1 } };
+    int i, n = 0;
+
+    for(i = 0; i < CACHE_SLOTS; i++)
+        for(entry = iscn->cache[i]; entry; entry = entry->next)
+            if(TRACKED(entry))
+                n++;
+    if(!n || !alloc_marks(iscn, img))
+        return(0);
+
+    for(i = 0; i < CACHE_SLOTS; i++)
+        for(entry = iscn->cache[i]; entry; entry = entry->next)
+            if(TRACKED(entry))
+                track_mark(iscn, img, entry, span);
+
+    iscn->fine_density[0] = CFG(iscn, ZBAR_CFG_Y_DENSITY);
+    iscn->fine_density[1] = CFG(iscn, ZBAR_CFG_X_DENSITY);
+    n = setup_marked(iscn, img, 0);
+
+    /* clip lines to the regions */
+    for(i = 0; i < 2; i++) {
+        scan_pass_t *pass = &iscn->pass[i];
+        int u1 = pass->u0 + pass->un;
+        if(span[i][0] > pass->u0)
+            pass->u0 = span[i][0];
+        if(span[i][1] + 1 < u1)
+            u1 = span[i][1] + 1;
+        pass->un = (u1 > pass->u0) ? u1 - pass->u0 : 0;
+    }
+    return(n);
+}
+
+/* save the bounding box of a symbol's location in its cache entry,
+ * keeping the previous box for motion prediction
+ */
+static void track_sym (zbar_image_scanner_t *iscn,
+                       zbar_symbol_t *sym)
+{
+    zbar_symbol_t *entry;
+    point_t box[4];
+    unsigned i;
+
+    if(sym->syms) {
+        zbar_symbol_t *child;
+        for(child = sym->syms->head; child; child = child->next)
+            track_sym(iscn, child);
+    }
+    if(!sym->npts || !(entry = cache_lookup(iscn, sym)))
+        return;
+
+    box[0] = box[1] = sym->pts[0];
+    for(i = 1; i < sym->npts; i++) {
+        const point_t *p = &sym->pts[i];
+        if(box[0].x > p->x) box[0].x = p->x;
+        if(box[0].y > p->y) box[0].y = p->y;
+        if(box[1].x < p->x) box[1].x = p->x;
+        if(box[1].y < p->y) box[1].y = p->y;
+    }
+    if(entry->npts == 4) {
+        box[2] = entry->pts[0];
+        box[3] = entry->pts[1];
+    }
+    else {
+        box[2] = box[0];
+        box[3] = box[1];
+    }
+    entry->npts = 0;
+    for(i = 0; i < 4; i++)
+        sym_add_point(entry, box[i].x, box[i].y);
+    entry->orient = sym->orient;
+}
+
+/* update tracked locations from the current results.  entries missing
+ * from this image are no longer tracked.
+ * returns non-zero if a tracked scan lost a symbol
+ */
+static int track_update (zbar_image_scanner_t *iscn,
+                         zbar_symbol_set_t *syms,
+                         int tracked)
+{
+    zbar_symbol_t *sym;
+    int i, lost = 0;
+    for(sym = syms->head; sym; sym = sym->next)
+        track_sym(iscn, sym);
+    for(i = 0; i < CACHE_SLOTS; i++)
+        for(sym = iscn->cache[i]; sym; sym = sym->next)
+            if(sym->time != iscn->time) {
+                /* unconfirmed results are often noise, those may vanish */
+                lost |= tracked && TRACKED(sym) && sym->cache_count >= 0;
+                sym->npts = 0;
+            }
+    return(lost);
+}
+
+/* sample the mean luma of each tile of the crop rectangle */
+static void image_signature (const zbar_image_scanner_t *iscn,
+                             const zbar_image_t *img,
+                             uint8_t *sig)
+{
+    int i, j;
+    for(j = 0; j < SIG_GRID; j++) {
+        unsigned y0 = img->crop_y + img->crop_h * j / SIG_GRID;
+        unsigned y1 = img->crop_y + img->crop_h * (j + 1) / SIG_GRID;
+        for(i = 0; i < SIG_GRID; i++) {
+            unsigned x0 = img->crop_x + img->crop_w * i / SIG_GRID;
+            unsigned x1 = img->crop_x + img->crop_w * (i + 1) / SIG_GRID;
+            unsigned x, y, sum = 0, n = 0;
+            for(y = y0; y < y1; y += SIG_SUBSAMPLE) {
+                const uint8_t *p = iscn->luma + y * iscn->luma_stride;
+                for(x = x0; x < x1; x += SIG_SUBSAMPLE, n++)
+                    sum += p[x * iscn->luma_step];
+            }
+            *(sig++) = (n) ? sum / n : 0;
+        }
+    }
+}
+
+/* check whether an image is close enough to the last scanned image
+ * that scanning may be skipped.  otherwise it becomes the reference
+ */
+static int image_unchanged (zbar_image_scanner_t *iscn,
+                            const zbar_image_t *img)
+{
+    int thresh = CFG(iscn, ZBAR_CFG_SKIP_THRESHOLD);
+    int interval = CFG(iscn, ZBAR_CFG_SKIP_INTERVAL);
+    uint8_t sig[SIG_GRID * SIG_GRID];
+    int i, diff = 0;
+
+    image_signature(iscn, img, sig);
+    if(iscn->sig_w && iscn->syms &&
+       iscn->sig_x == img->crop_x && iscn->sig_y == img->crop_y &&
+       iscn->sig_w == img->crop_w && iscn->sig_h == img->crop_h &&
+       (interval <= 0 || iscn->skipped + 1 < interval)) {
+        for(i = 0; i < SIG_GRID * SIG_GRID && diff < thresh; i++) {
+            int d = abs(sig[i] - iscn->sig[i]);
+            if(diff < d)
+                diff = d;
+        }
+        if(diff < thresh) {
+            iscn->skipped++;
+            return(1);
+        }
+    }
+
+    memcpy(iscn->sig, sig, sizeof(sig));
+    iscn->sig_x = img->crop_x;
+    iscn->sig_y = img->crop_y;
+    iscn->sig_w = img->crop_w;
+    iscn->sig_h = img->crop_h;
+    iscn->skipped = 0;
+    return(0);
+}
+
+/* report the previous results again for an unchanged image */
+static int rescan_skipped (zbar_image_scanner_t *iscn,
+                           zbar_image_t *img)
+{
+    zbar_symbol_set_t *syms = iscn->syms;
+    iscn->img = NULL;
+    if(iscn->enable_stats)
+        memset(&iscn->stats, 0, sizeof(iscn->stats));
+    if(img->syms != syms) {
+        if(img->syms)
+            zbar_symbol_set_ref(img->syms, -1);
+        zbar_symbol_set_ref(syms, 1);
+        img->syms = syms;
+    }
+
+    /* cached results were already reported.  they are still in view,
+     * so keep them from expiring (and being reported again) over a
+     * long run of skipped images
+     */
+    if(iscn->enable_cache) {
+        zbar_symbol_t *sym;
+        iscn->time = _zbar_timer_now();
+        for(sym = syms->head; sym; sym = sym->next) {
+            zbar_symbol_t *entry = cache_lookup(iscn, sym);
+            if(entry)
+                entry->time = iscn->time;
+        }
+        return(0);
+    }
+    if(syms->nsyms && iscn->handler)
+        iscn->handler(img, iscn->userdata);
+    return(syms->nsyms);
+}
+
+/* setup a new result set for an image */
+static zbar_symbol_set_t *begin_scan (zbar_image_scanner_t *iscn,
+                                      zbar_image_t *img)
+{
+    zbar_symbol_set_t *syms;
+    int i, nctx = 1;
+
+    if(iscn->enable_stats)
+        stats_begin(iscn);
+
+    /* timestamp image
+     * FIXME prefer video timestamp
+     */
+    iscn->time = _zbar_timer_now();
+    if(iscn->deadline_us)
+        _zbar_timer_init_us(&iscn->deadline, iscn->deadline_us);
+#ifdef HAVE_THREADS
+    nctx += iscn->nworkers;
+#endif
+    for(i = 0; i < nctx; i++)
+        get_ctx(iscn, i)->timeout = 0;
+    iscn->nconfirmed = iscn->satisfied = 0;
+    memset(iscn->sym_confirmed, 0, sizeof(iscn->sym_confirmed));
+
+#ifdef ENABLE_QRCODE
+    _zbar_qr_reset(iscn->qr);
+#endif
 
     /* recycle previous scanner and image results */
     zbar_image_scanner_recycle_image(iscn, img);
@@ -676,6 +2192,37 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
     else
         zbar_symbol_set_ref(syms, 2);
     img->syms = syms;
+    table_clear(&iscn->results);
+    if(iscn->enable_cache)
+        cache_expire(iscn);
+    return(syms);
+}
+
+static int finish_scan (zbar_image_scanner_t *iscn,
+                        zbar_image_t *img,
+                        int track,
+                        int tracked);
+
+int zbar_scan_image (zbar_image_scanner_t *iscn,
+                     zbar_image_t *img)
+{
+    unsigned w, h, cx1, cy1;
+    int density, track, tracked = 0, n;
+
+    /* luma is scanned in place from grayscale and YUV formats */
+    iscn->luma = _zbar_image_get_luma(img, &iscn->luma_step,
+                                      &iscn->luma_stride);
+    if(!iscn->luma)
+        return(-1);
+    iscn->img = img;
+
+    if(CFG(iscn, ZBAR_CFG_SKIP_THRESHOLD) > 0 && image_unchanged(iscn, img))
+        return(rescan_skipped(iscn, img));
+
+    begin_scan(iscn, img);
+    clear_edges(iscn);
+    iscn->edges_w = img->width;
+    iscn->edges_h = img->height;
 
     w = img->width;
     h = img->height;
@@ -683,133 +2230,89 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
     assert(cx1 <= w);
     cy1 = img->crop_y + img->crop_h;
     assert(cy1 <= h);
-    data = img->data;
 
     zbar_image_write_png(img, "debug.png");
     svg_open("debug.svg", 0, 0, w, h);
     svg_image("debug.png", w, h);
 
-    zbar_scanner_new_scan(scn);
+    zbar_scanner_new_scan(iscn->ctx.scn);
 
-    density = CFG(iscn, ZBAR_CFG_Y_DENSITY);
-    if(density > 0) {
-        const uint8_t *p = data;
-        int x = 0, y = 0;
+    density = CFG(iscn, ZBAR_CFG_X_DENSITY);
+    iscn->coarse = 0;
 
-        int border = (((img->crop_h - 1) % density) + 1) / 2;
-        if(border > img->crop_h / 2)
-            border = img->crop_h / 2;
-        border += img->crop_y;
-        assert(border <= h);
-        svg_group_start("scanner", 0, 1, 1, 0, 0);
-        iscn->dy = 0;
-
-        movedelta(img->crop_x, border);
-        iscn->v = y;
-
-        while(y < cy1) {
-            int cx0 = img->crop_x;;
-            zprintf(128, "img_x+: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", 1. / 32, 0, y + 0.5);
-            iscn->dx = iscn->du = 1;
-            iscn->umin = cx0;
-            while(x < cx1) {
-                uint8_t d = *p;
-                movedelta(1, 0);
-                zbar_scan_y(scn, d);
-            }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
-
-            movedelta(-1, density);
-            iscn->v = y;
-            if(y >= cy1)
-                break;
-
-            zprintf(128, "img_x-: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", -1. / 32, w, y + 0.5);
-            iscn->dx = iscn->du = -1;
-            iscn->umin = cx1;
-            while(x >= cx0) {
-                uint8_t d = *p;
-                movedelta(-1, 0);
-                zbar_scan_y(scn, d);
-            }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
+    /* between periodic full scans of a video stream,
+     * only look where the cached symbols are expected to be
+     */
+    track = iscn->enable_cache && CFG(iscn, ZBAR_CFG_TRACK_INTERVAL) > 0;
+    if(track && iscn->track_frames &&
+       iscn->track_frames < CFG(iscn, ZBAR_CFG_TRACK_INTERVAL))
+        tracked = track_setup(iscn, img) > 0;
 
-            movedelta(1, density);
-            iscn->v = y;
+    if(tracked)
+        scan_passes(iscn, img);
+    else {
+        setup_pass(&iscn->pass[0], img, 0, CFG(iscn, ZBAR_CFG_Y_DENSITY));
+        setup_pass(&iscn->pass[1], img, 1, density);
+
+        /* optionally scan sparsely first, then refine only where the
+         * decoders saw something
+         */
+        if(CFG(iscn, ZBAR_CFG_COARSE_DENSITY) > 0)
+            iscn->coarse = coarse_setup(iscn, img);
+        scan_passes(iscn, img);
+        if(iscn->coarse) {
+            int coarse = iscn->coarse;
+            iscn->coarse = 0;
+            if(!scan_stopped(&iscn->ctx) && fine_setup(iscn, img, coarse))
+                scan_passes(iscn, img);
         }
-        svg_group_end();
     }
-    iscn->dx = 0;
+    iscn->img = NULL;
 
-    density = CFG(iscn, ZBAR_CFG_X_DENSITY);
-    if(density > 0) {
-        const uint8_t *p = data;
-        int x = 0, y = 0;
-
-        int border = (((img->crop_w - 1) % density) + 1) / 2;
-        if(border > img->crop_w / 2)
-            border = img->crop_w / 2;
-        border += img->crop_x;
-        assert(border <= w);
-        svg_group_start("scanner", 90, 1, -1, 0, 0);
-        movedelta(border, img->crop_y);
-        iscn->v = x;
-
-        while(x < cx1) {
-            int cy0 = img->crop_y;
-            zprintf(128, "img_y+: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", 1. / 32, 0, x + 0.5);
-            iscn->dy = iscn->du = 1;
-            iscn->umin = cy0;
-            while(y < cy1) {
-                uint8_t d = *p;
-                movedelta(0, 1);
-                zbar_scan_y(scn, d);
-            }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
-
-            movedelta(density, -1);
-            iscn->v = x;
-            if(x >= cx1)
-                break;
-
-            zprintf(128, "img_y-: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", -1. / 32, h, x + 0.5);
-            iscn->dy = iscn->du = -1;
-            iscn->umin = cy1;
-            while(y >= cy0) {
-                uint8_t d = *p;
-                movedelta(0, -1);
-                zbar_scan_y(scn, d);
-            }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
+    n = finish_scan(iscn, img, track, tracked);
+    svg_close();
+    return(n);
+}
 
-            movedelta(density, 1);
-            iscn->v = x;
-        }
-        svg_group_end();
-    }
-    iscn->dy = 0;
+int zbar_redecode_image (zbar_image_scanner_t *iscn,
+                         zbar_image_t *img)
+{
+    if(!iscn->nsegs ||
+       img->width != iscn->edges_w || img->height != iscn->edges_h)
+        return(-1);
+    /* QR Code decoding rereads the image luma */
+    iscn->luma = _zbar_image_get_luma(img, &iscn->luma_step,
+                                      &iscn->luma_stride);
+    if(!iscn->luma)
+        return(-1);
+
+    begin_scan(iscn, img);
+    /* decode as from a new scanner (not after the last scan) */
+    zbar_scanner_reset(iscn->ctx.scn);
+    iscn->img = img;
+    iscn->coarse = 0;
+    redecode_lines(iscn);
     iscn->img = NULL;
+    return(finish_scan(iscn, img, 0, 0));
+}
+
+/* decode 2D symbols and clean up linear results of an image scan */
+static int finish_scan (zbar_image_scanner_t *iscn,
+                        zbar_image_t *img,
+                        int track,
+                        int tracked)
+{
+    zbar_symbol_set_t *syms = iscn->syms;
+    unsigned long lap = 0;
 
 #ifdef ENABLE_QRCODE
     _zbar_qr_decode(iscn->qr, iscn, img);
 #endif
+    syms->truncated = scan_truncated(iscn);
+    _zbar_image_scanner_lap(iscn, SCAN_STAGE_START, &lap);
 
-    /* FIXME tmp hack to filter bad EAN results */
+    /* FIXME tmp hack to filter bad EAN results (see confirm_quality) */
     /* FIXME tmp hack to merge simple case EAN add-ons */
-    char filter = (!iscn->enable_cache &&
-                   (density == 1 || CFG(iscn, ZBAR_CFG_Y_DENSITY) == 1));
     int nean = 0, naddon = 0;
     if(syms->nsyms) {
         zbar_symbol_t **symp;
@@ -821,7 +2324,7 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
                 sym->type == ZBAR_DATABAR_EXP ||
                 sym->type == ZBAR_CODABAR))
             {
-	        if((sym->type == ZBAR_CODABAR || filter) && sym->quality < 4) {
+	        if(sym->quality < confirm_quality(iscn, sym->type)) {
                     if(iscn->enable_cache) {
                         /* revert cache update */
                         zbar_symbol_t *entry = cache_lookup(iscn, sym);
@@ -831,10 +2334,11 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
                             assert(0);
                     }
 
-                    /* recycle */
+                    /* recycle (no longer a result) */
                     *symp = sym->next;
                     syms->nsyms--;
                     sym->next = NULL;
+                    table_remove(&iscn->results, sym);
                     _zbar_image_scanner_recycle_syms(iscn, sym);
                     continue;
                 }
@@ -885,11 +2389,22 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
             _zbar_image_scanner_add_sym(iscn, ean_sym);
         }
     }
+    _zbar_image_scanner_lap(iscn, SCAN_STAGE_FILTER, &lap);
+
+    if(track) {
+        /* a lost symbol forces a full scan of the next image */
+        if(!tracked)
+            iscn->track_frames = 0;
+        if(track_update(iscn, syms, tracked))
+            iscn->track_frames = 0;
+        else
+            iscn->track_frames++;
+    }
 
+    if(iscn->enable_stats)
+        stats_end(iscn);
     if(syms->nsyms && iscn->handler)
         iscn->handler(img, iscn->userdata);
-
-    svg_close();
     return(syms->nsyms);
 }
 
@@ -34,5 +34,29 @@ extern void _zbar_image_scanner_add_sym(zbar_image_scanner_t*,
                                         zbar_symbol_t*);
 extern void _zbar_image_scanner_recycle_syms(zbar_image_scanner_t*,
                                              zbar_symbol_t*);
+extern int _zbar_image_scanner_stopped(zbar_image_scanner_t*);
+/* whether n more confirmed results of a symbology would be enough */
+extern int _zbar_image_scanner_satisfied(const zbar_image_scanner_t*,
+                                         zbar_symbol_type_t,
+                                         int);
+
+/* image scan stages timed for statistics (see zbar_scan_stats_t) */
+typedef enum scan_stage_e {
+    SCAN_STAGE_START = -1,      /* only restart the lap */
+    SCAN_STAGE_X,
+    SCAN_STAGE_Y,
+    SCAN_STAGE_QR_LOCATE,
+    SCAN_STAGE_QR_BINARIZE,
+    SCAN_STAGE_QR_DECODE,
+    SCAN_STAGE_FILTER,
+    NUM_SCAN_STAGES
+} scan_stage_t;
+
+/* add the time since *lap to a stage and restart the lap
+ * (no-op unless statistics are enabled)
+ */
+extern void _zbar_image_scanner_lap(zbar_image_scanner_t*,
+                                    scan_stage_t,
+                                    unsigned long*);
 
 #endif
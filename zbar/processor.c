@@ -69,9 +69,14 @@ int _zbar_process_image (zbar_processor_t *proc,
         /* FIXME locking all other interfaces while processing is conservative
          * but easier for now and we don't expect this to take long...
          */
-        zbar_image_t *tmp = zbar_image_convert(img, fourcc('Y','8','0','0'));
-        if(!tmp)
-            goto error;
+        /* grayscale and YUV frames are scanned in place */
+        unsigned step, stride;
+        zbar_image_t *tmp = img;
+        if(!_zbar_image_get_luma(img, &step, &stride)) {
+            tmp = zbar_image_convert(img, fourcc('Y','8','0','0'));
+            if(!tmp)
+                goto error;
+        }
 
         if(proc->syms) {
             zbar_symbol_set_ref(proc->syms, -1);
@@ -79,9 +84,10 @@ int _zbar_process_image (zbar_processor_t *proc,
         }
         zbar_image_scanner_recycle_image(proc->scanner, img);
         int nsyms = zbar_scan_image(proc->scanner, tmp);
-        _zbar_image_swap_symbols(img, tmp);
-
-        zbar_image_destroy(tmp);
+        if(tmp != img) {
+            _zbar_image_swap_symbols(img, tmp);
+            zbar_image_destroy(tmp);
+        }
         tmp = NULL;
         if(nsyms < 0)
             goto error;
@@ -53,6 +53,7 @@ struct qr_finder_line {
 };
 
 qr_reader *_zbar_qr_create(void);
+qr_reader *_zbar_qr_clone(const qr_reader *src);
 void _zbar_qr_destroy(qr_reader *reader);
 void _zbar_qr_reset(qr_reader *reader);
 
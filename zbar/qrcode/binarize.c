@@ -9,6 +9,15 @@
 #include "util.h"
 #include "image.h"
 #include "binarize.h"
+#if defined(__SSE2__)
+# include <emmintrin.h>
+# define QR_BINARIZE_SSE2 (1)
+#endif
+#if defined(__GNUC__)&&(defined(__x86_64__)||defined(__i386__))&& \
+ (defined(__clang__)||__GNUC__>4||__GNUC__==4&&__GNUC_MINOR__>=9)
+# include <immintrin.h>
+# define QR_BINARIZE_AVX2 (1)
+#endif
 
 #if 0
 /*Binarization based on~\cite{GPP06}.
@@ -519,74 +528,375 @@ void qr_binarize(unsigned char *_img,int _width,int _height){
 
 /*A simplified adaptive thresholder.
   This compares the current pixel value to the mean value of a (large) window
-   surrounding it.*/
-unsigned char *qr_binarize(const unsigned char *_img,int _width,int _height){
-  unsigned char *mask = NULL;
-  if(_width>0&&_height>0){
-    unsigned      *col_sums;
-    int            logwindw;
-    int            logwindh;
-    int            windw;
-    int            windh;
-    int            y0offs;
-    int            y1offs;
-    unsigned       g;
-    int            x;
-    int            y;
-    mask=(unsigned char *)malloc(_width*_height*sizeof(*mask));
-    /*We keep the window size fairly large to ensure it doesn't fit completely
-       inside the center of a finder pattern of a version 1 QR code at full
-       resolution.*/
-    for(logwindw=4;logwindw<8&&(1<<logwindw)<(_width+7>>3);logwindw++);
-    for(logwindh=4;logwindh<8&&(1<<logwindh)<(_height+7>>3);logwindh++);
-    windw=1<<logwindw;
-    windh=1<<logwindh;
-    col_sums=(unsigned *)malloc(_width*sizeof(*col_sums));
-    /*Initialize sums down each column.*/
-    for(x=0;x<_width;x++){
-      g=_img[x];
-      col_sums[x]=(g<<logwindh-1)+g;
+   surrounding it.
+  Only the pixels in [_x0,_x1)x[_y0,_y1) are written, but the window sums
+   still cover (and are clamped to) the whole image, so each pixel gets the
+   same value it would if the entire image were binarized at once.
+  This is the reference implementation the vectorized versions below must
+   match exactly.*/
+void qr_binarize_rect_c(unsigned char *_mask,const unsigned char *_img,
+ int _width,int _height,int _stride,int _x0,int _y0,int _x1,int _y1){
+  unsigned *col_sums;
+  int       logwindw;
+  int       logwindh;
+  int       windw;
+  int       windh;
+  int       cx0;
+  int       cx1;
+  int       y0offs;
+  int       y1offs;
+  unsigned  g;
+  int       x;
+  int       y;
+  if(_x0>=_x1||_y0>=_y1)return;
+  /*We keep the window size fairly large to ensure it doesn't fit completely
+     inside the center of a finder pattern of a version 1 QR code at full
+     resolution.*/
+  for(logwindw=4;logwindw<8&&(1<<logwindw)<(_width+7>>3);logwindw++);
+  for(logwindh=4;logwindh<8&&(1<<logwindh)<(_height+7>>3);logwindh++);
+  windw=1<<logwindw;
+  windh=1<<logwindh;
+  /*Only the columns some window in the rectangle touches are summed.*/
+  cx0=QR_MAXI(0,_x0-(windw>>1));
+  cx1=QR_MINI(_x1+(windw>>1),_width);
+  col_sums=(unsigned *)malloc((cx1-cx0)*sizeof(*col_sums));
+  /*Initialize sums down each column.*/
+  for(x=cx0;x<cx1;x++)col_sums[x-cx0]=0;
+  for(y=_y0-(windh>>1);y<_y0+(windh>>1);y++){
+    y1offs=QR_CLAMPI(0,y,_height-1)*_stride;
+    for(x=cx0;x<cx1;x++){
+      g=_img[y1offs+x];
+      col_sums[x-cx0]+=g;
     }
-    for(y=1;y<(windh>>1);y++){
-      y1offs=QR_MINI(y,_height-1)*_width;
-      for(x=0;x<_width;x++){
-        g=_img[y1offs+x];
-        col_sums[x]+=g;
-      }
+  }
+  for(y=_y0;y<_y1;y++){
+    unsigned m;
+    int      x0;
+    int      x1;
+    /*Initialize the sum over the window.*/
+    m=0;
+    for(x=_x0-(windw>>1);x<_x0+(windw>>1);x++){
+      x1=QR_CLAMPI(0,x,_width-1);
+      m+=col_sums[x1-cx0];
     }
-    for(y=0;y<_height;y++){
-      unsigned m;
-      int      x0;
-      int      x1;
-      /*Initialize the sum over the window.*/
-      m=(col_sums[0]<<logwindw-1)+col_sums[0];
-      for(x=1;x<(windw>>1);x++){
-        x1=QR_MINI(x,_width-1);
-        m+=col_sums[x1];
+    for(x=_x0;x<_x1;x++){
+      /*Perform the test against the threshold T = (m/n)-D,
+         where n=windw*windh and D=3.*/
+      g=_img[y*_stride+x];
+      _mask[y*_width+x]=-(g+3<<logwindw+logwindh<m)&0xFF;
+      /*Update the window sum.*/
+      if(x+1<_x1){
+        x0=QR_MAXI(0,x-(windw>>1));
+        x1=QR_MINI(x+(windw>>1),_width-1);
+        m+=col_sums[x1-cx0]-col_sums[x0-cx0];
       }
-      for(x=0;x<_width;x++){
-        /*Perform the test against the threshold T = (m/n)-D,
-           where n=windw*windh and D=3.*/
-        g=_img[y*_width+x];
-        mask[y*_width+x]=-(g+3<<logwindw+logwindh<m)&0xFF;
-        /*Update the window sum.*/
-        if(x+1<_width){
-          x0=QR_MAXI(0,x-(windw>>1));
-          x1=QR_MINI(x+(windw>>1),_width-1);
-          m+=col_sums[x1]-col_sums[x0];
-        }
-      }
-      /*Update the column sums.*/
-      if(y+1<_height){
-        y0offs=QR_MAXI(0,y-(windh>>1))*_width;
-        y1offs=QR_MINI(y+(windh>>1),_height-1)*_width;
-        for(x=0;x<_width;x++){
-          col_sums[x]-=_img[y0offs+x];
-          col_sums[x]+=_img[y1offs+x];
-        }
+    }
+    /*Update the column sums.*/
+    if(y+1<_y1){
+      y0offs=QR_MAXI(0,y-(windh>>1))*_stride;
+      y1offs=QR_MINI(y+(windh>>1),_height-1)*_stride;
+      for(x=cx0;x<cx1;x++){
+        col_sums[x-cx0]-=_img[y0offs+x];
+        col_sums[x-cx0]+=_img[y1offs+x];
       }
     }
-    free(col_sums);
+  }
+  free(col_sums);
+}
+
+/*The vectorized thresholder.
+  The column sums are updated several columns at a time.
+  Along a row, the window sum at x+1 differs from the one at x by
+   d[x]=col_sums[x+windw/2]-col_sums[x-windw/2], so a block of window sums is
+   just a running sum of those differences, which we compute with a log-step
+   prefix sum in each register.
+  Pixels whose window gets clamped at the left or right side of the image
+   still use the scalar update from the reference code.*/
+typedef struct qr_binarize_kernel qr_binarize_kernel;
+
+struct qr_binarize_kernel{
+  /*The number of pixels row_mask() processes per step.*/
+  int        nlanes;
+  /*Adds the row _add to the column sums, and subtracts _sub, if not NULL.*/
+  void     (*col_sums_update)(unsigned *_col_sums,const unsigned char *_sub,
+   const unsigned char *_add,int _n);
+  /*Thresholds _n pixels, given the window sum _m for the first one, and
+     pointers to the column sums leaving (_lo) and entering (_hi) the window.
+    Returns the window sum for the pixel after the last one.*/
+  unsigned (*row_mask)(unsigned char *_mask,const unsigned char *_img,
+   const unsigned *_lo,const unsigned *_hi,int _n,unsigned _m,int _logn);
+};
+
+#if defined(QR_BINARIZE_SSE2)
+static void qr_col_sums_update_sse2(unsigned *_col_sums,
+ const unsigned char *_sub,const unsigned char *_add,int _n){
+  __m128i zero;
+  int     x;
+  zero=_mm_setzero_si128();
+  for(x=0;x+16<=_n;x+=16){
+    __m128i a;
+    __m128i d[2];
+    int     i;
+    a=_mm_loadu_si128((const __m128i *)(_add+x));
+    d[0]=_mm_unpacklo_epi8(a,zero);
+    d[1]=_mm_unpackhi_epi8(a,zero);
+    if(_sub!=NULL){
+      __m128i s;
+      s=_mm_loadu_si128((const __m128i *)(_sub+x));
+      d[0]=_mm_sub_epi16(d[0],_mm_unpacklo_epi8(s,zero));
+      d[1]=_mm_sub_epi16(d[1],_mm_unpackhi_epi8(s,zero));
+    }
+    for(i=0;i<4;i++){
+      __m128i *p;
+      __m128i  v;
+      /*Sign-extend the 16-bit differences.*/
+      v=i&1?_mm_unpackhi_epi16(d[i>>1],d[i>>1]):
+       _mm_unpacklo_epi16(d[i>>1],d[i>>1]);
+      v=_mm_srai_epi32(v,16);
+      p=(__m128i *)(_col_sums+x+4*i);
+      _mm_storeu_si128(p,_mm_add_epi32(_mm_loadu_si128(p),v));
+    }
+  }
+  for(;x<_n;x++){
+    if(_sub!=NULL)_col_sums[x]-=_sub[x];
+    _col_sums[x]+=_add[x];
+  }
+}
+
+static unsigned qr_row_mask_sse2(unsigned char *_mask,
+ const unsigned char *_img,const unsigned *_lo,const unsigned *_hi,int _n,
+ unsigned _m,int _logn){
+  __m128i zero;
+  __m128i three;
+  __m128i shift;
+  __m128i m;
+  int     x;
+  zero=_mm_setzero_si128();
+  three=_mm_set1_epi16(3);
+  shift=_mm_cvtsi32_si128(_logn);
+  m=_mm_set1_epi32((int)_m);
+  for(x=0;x<_n;x+=16){
+    __m128i g;
+    __m128i g16[2];
+    __m128i r[4];
+    int     i;
+    g=_mm_loadu_si128((const __m128i *)(_img+x));
+    g16[0]=_mm_add_epi16(_mm_unpacklo_epi8(g,zero),three);
+    g16[1]=_mm_add_epi16(_mm_unpackhi_epi8(g,zero),three);
+    for(i=0;i<4;i++){
+      __m128i d;
+      __m128i s;
+      __m128i t;
+      d=_mm_sub_epi32(_mm_loadu_si128((const __m128i *)(_hi+x+4*i)),
+       _mm_loadu_si128((const __m128i *)(_lo+x+4*i)));
+      /*Exclusive prefix sum of the differences, offset by the current sum.*/
+      s=_mm_slli_si128(d,4);
+      s=_mm_add_epi32(s,_mm_slli_si128(s,4));
+      s=_mm_add_epi32(s,_mm_slli_si128(s,8));
+      s=_mm_add_epi32(s,m);
+      t=i&1?_mm_unpackhi_epi16(g16[i>>1],zero):
+       _mm_unpacklo_epi16(g16[i>>1],zero);
+      /*Both sides are less than 2**25, so a signed compare is safe.*/
+      r[i]=_mm_cmplt_epi32(_mm_sll_epi32(t,shift),s);
+      m=_mm_shuffle_epi32(_mm_add_epi32(s,d),0xFF);
+    }
+    _mm_storeu_si128((__m128i *)(_mask+x),_mm_packs_epi16(
+     _mm_packs_epi32(r[0],r[1]),_mm_packs_epi32(r[2],r[3])));
+  }
+  return (unsigned)_mm_cvtsi128_si32(m);
+}
+
+static const qr_binarize_kernel QR_BINARIZE_KERNEL_SSE2={
+  16,qr_col_sums_update_sse2,qr_row_mask_sse2
+};
+#endif
+
+#if defined(QR_BINARIZE_AVX2)
+__attribute__((target("avx2")))
+static void qr_col_sums_update_avx2(unsigned *_col_sums,
+ const unsigned char *_sub,const unsigned char *_add,int _n){
+  int x;
+  for(x=0;x+8<=_n;x+=8){
+    __m256i *p;
+    __m256i  v;
+    v=_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(_add+x)));
+    if(_sub!=NULL){
+      v=_mm256_sub_epi32(v,
+       _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(_sub+x))));
+    }
+    p=(__m256i *)(_col_sums+x);
+    _mm256_storeu_si256(p,_mm256_add_epi32(_mm256_loadu_si256(p),v));
+  }
+  for(;x<_n;x++){
+    if(_sub!=NULL)_col_sums[x]-=_sub[x];
+    _col_sums[x]+=_add[x];
+  }
+}
+
+__attribute__((target("avx2")))
+static unsigned qr_row_mask_avx2(unsigned char *_mask,
+ const unsigned char *_img,const unsigned *_lo,const unsigned *_hi,int _n,
+ unsigned _m,int _logn){
+  __m256i three;
+  __m256i last;
+  __m256i order;
+  __m128i shift;
+  __m256i m;
+  int     x;
+  three=_mm256_set1_epi32(3);
+  last=_mm256_set1_epi32(7);
+  order=_mm256_setr_epi32(0,4,1,5,2,6,3,7);
+  shift=_mm_cvtsi32_si128(_logn);
+  m=_mm256_set1_epi32((int)_m);
+  for(x=0;x<_n;x+=32){
+    __m256i r[4];
+    int     i;
+    for(i=0;i<4;i++){
+      __m256i d;
+      __m256i s;
+      __m256i c;
+      __m256i t;
+      d=_mm256_sub_epi32(
+       _mm256_loadu_si256((const __m256i *)(_hi+x+8*i)),
+       _mm256_loadu_si256((const __m256i *)(_lo+x+8*i)));
+      /*Exclusive prefix sum within each 128-bit half...*/
+      s=_mm256_slli_si256(d,4);
+      s=_mm256_add_epi32(s,_mm256_slli_si256(s,4));
+      s=_mm256_add_epi32(s,_mm256_slli_si256(s,8));
+      /*...plus the total of the low half carried into the high half.*/
+      c=_mm256_add_epi32(s,d);
+      c=_mm256_shuffle_epi32(_mm256_permute2x128_si256(c,c,0x08),0xFF);
+      s=_mm256_add_epi32(_mm256_add_epi32(s,c),m);
+      t=_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(_img+x+8*i)));
+      t=_mm256_sll_epi32(_mm256_add_epi32(t,three),shift);
+      r[i]=_mm256_cmpgt_epi32(s,t);
+      m=_mm256_permutevar8x32_epi32(_mm256_add_epi32(s,d),last);
+    }
+    /*The packs work within each 128-bit half, so put the dwords back in
+       order afterwards.*/
+    _mm256_storeu_si256((__m256i *)(_mask+x),_mm256_permutevar8x32_epi32(
+     _mm256_packs_epi16(_mm256_packs_epi32(r[0],r[1]),
+     _mm256_packs_epi32(r[2],r[3])),order));
+  }
+  return (unsigned)_mm_cvtsi128_si32(_mm256_castsi256_si128(m));
+}
+
+static const qr_binarize_kernel QR_BINARIZE_KERNEL_AVX2={
+  32,qr_col_sums_update_avx2,qr_row_mask_avx2
+};
+#endif
+
+/*Picks the widest kernel the CPU we are running on supports, or returns NULL
+   to use the reference code.*/
+static const qr_binarize_kernel *qr_binarize_kernel_select(void){
+#if defined(QR_BINARIZE_AVX2)
+  if(__builtin_cpu_supports("avx2"))return &QR_BINARIZE_KERNEL_AVX2;
+#endif
+#if defined(QR_BINARIZE_SSE2)
+  return &QR_BINARIZE_KERNEL_SSE2;
+#else
+  return NULL;
+#endif
+}
+
+/*Thresholds the pixels in [_x0,_x1) of one row with the scalar update.*/
+static unsigned qr_binarize_span(unsigned char *_mask,
+ const unsigned char *_img,const unsigned *_col_sums,int _cx0,int _width,
+ int _windw,int _logn,int _x0,int _x1,unsigned _m){
+  int x;
+  for(x=_x0;x<_x1;x++){
+    int x0;
+    int x1;
+    _mask[x]=-(_img[x]+3<<_logn<_m)&0xFF;
+    x0=QR_MAXI(0,x-(_windw>>1));
+    x1=QR_MINI(x+(_windw>>1),_width-1);
+    _m+=_col_sums[x1-_cx0]-_col_sums[x0-_cx0];
+  }
+  return _m;
+}
+
+static void qr_binarize_rect_simd(const qr_binarize_kernel *_k,
+ unsigned char *_mask,const unsigned char *_img,int _width,int _height,
+ int _stride,int _x0,int _y0,int _x1,int _y1,unsigned *_col_sums){
+  unsigned *col_sums;
+  int       logwindw;
+  int       logwindh;
+  int       windw;
+  int       windh;
+  int       cx0;
+  int       cx1;
+  int       xv0;
+  int       xv1;
+  int       x;
+  int       y;
+  if(_x0>=_x1||_y0>=_y1)return;
+  for(logwindw=4;logwindw<8&&(1<<logwindw)<(_width+7>>3);logwindw++);
+  for(logwindh=4;logwindh<8&&(1<<logwindh)<(_height+7>>3);logwindh++);
+  windw=1<<logwindw;
+  windh=1<<logwindh;
+  cx0=QR_MAXI(0,_x0-(windw>>1));
+  cx1=QR_MINI(_x1+(windw>>1),_width);
+  if(_col_sums!=NULL){
+    col_sums=_col_sums;
+    memset(col_sums,0,(cx1-cx0)*sizeof(*col_sums));
+  }
+  else col_sums=(unsigned *)calloc(cx1-cx0,sizeof(*col_sums));
+  for(y=_y0-(windh>>1);y<_y0+(windh>>1);y++){
+    (*_k->col_sums_update)(col_sums,NULL,
+     _img+QR_CLAMPI(0,y,_height-1)*_stride+cx0,cx1-cx0);
+  }
+  /*The vector code handles the pixels in [xv0,xv1), whose windows (and the
+     window of the pixel following each of them) need no clamping.*/
+  xv0=QR_CLAMPI(_x0,windw>>1,_x1);
+  xv1=QR_CLAMPI(xv0,_width-(windw>>1),_x1);
+  xv1-=(xv1-xv0)%_k->nlanes;
+  for(y=_y0;y<_y1;y++){
+    unsigned char *mask;
+    const unsigned char *img;
+    unsigned       m;
+    mask=_mask+y*_width;
+    img=_img+y*_stride;
+    m=0;
+    for(x=_x0-(windw>>1);x<_x0+(windw>>1);x++){
+      m+=col_sums[QR_CLAMPI(0,x,_width-1)-cx0];
+    }
+    m=qr_binarize_span(mask,img,col_sums,cx0,_width,windw,
+     logwindw+logwindh,_x0,xv0,m);
+    if(xv0<xv1){
+      m=(*_k->row_mask)(mask+xv0,img+xv0,col_sums+xv0-(windw>>1)-cx0,
+       col_sums+xv0+(windw>>1)-cx0,xv1-xv0,m,logwindw+logwindh);
+    }
+    qr_binarize_span(mask,img,col_sums,cx0,_width,windw,
+     logwindw+logwindh,xv1,_x1,m);
+    if(y+1<_y1){
+      (*_k->col_sums_update)(col_sums,
+       _img+QR_MAXI(0,y-(windh>>1))*_stride+cx0,
+       _img+QR_MINI(y+(windh>>1),_height-1)*_stride+cx0,cx1-cx0);
+    }
+  }
+  if(col_sums!=_col_sums)free(col_sums);
+}
+
+void qr_binarize_rect(unsigned char *_mask,const unsigned char *_img,
+ int _width,int _height,int _stride,int _x0,int _y0,int _x1,int _y1,
+ unsigned *_col_sums){
+  const qr_binarize_kernel *k;
+  k=qr_binarize_kernel_select();
+  if(k!=NULL){
+    qr_binarize_rect_simd(k,_mask,_img,_width,_height,_stride,
+     _x0,_y0,_x1,_y1,_col_sums);
+  }
+  else{
+    qr_binarize_rect_c(_mask,_img,_width,_height,_stride,_x0,_y0,_x1,_y1);
+  }
+}
+
+unsigned char *qr_binarize(const unsigned char *_img,int _width,int _height){
+  unsigned char *mask = NULL;
+  if(_width>0&&_height>0){
+    mask=(unsigned char *)malloc(_width*_height*sizeof(*mask));
+    qr_binarize_rect(mask,_img,_width,_height,_width,
+     0,0,_width,_height,NULL);
   }
 #if defined(QR_DEBUG)
   {
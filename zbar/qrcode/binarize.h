@@ -14,4 +14,16 @@ void qr_wiener_filter(unsigned char *_img,int _width,int _height);
 /*Binarizes a grayscale image.*/
 unsigned char *qr_binarize(const unsigned char *_img,int _width,int _height);
 
+/*Binarizes a rectangle of a grayscale image into a full size mask.
+  Uses the widest vector implementation the CPU supports.
+  Rows of _img are _stride bytes apart; the mask is always packed _width bytes
+   per row.
+  _col_sums is scratch space for _width column sums, or NULL to allocate it.*/
+void qr_binarize_rect(unsigned char *_mask,const unsigned char *_img,
+ int _width,int _height,int _stride,int _x0,int _y0,int _x1,int _y1,
+ unsigned *_col_sums);
+/*The scalar reference implementation of qr_binarize_rect().*/
+void qr_binarize_rect_c(unsigned char *_mask,const unsigned char *_img,
+ int _width,int _height,int _stride,int _x0,int _y0,int _x1,int _y1);
+
 #endif
@@ -16,7 +16,9 @@
 #include "util.h"
 #include "binarize.h"
 #include "image.h"
+#include "img_scanner.h"
 #include "error.h"
+#include "refcnt.h"
 #include "svg.h"
 
 typedef int qr_line[3];
@@ -61,44 +63,89 @@ typedef struct qr_finder_lines {
 } qr_finder_lines;
 
 
-struct qr_reader {
+/* immutable tables shared by a reader and its clones */
+typedef struct qr_reader_tables {
+    refcnt_t refcnt;
     /*The GF(256) representation used in Reed-Solomon decoding.*/
     rs_gf256  gf;
+    /*The initial state of the RANSAC random number generator.*/
+    isaac_ctx isaac;
+} qr_reader_tables;
+
+struct qr_reader {
+    /* shared decoding tables */
+    qr_reader_tables *tables;
     /*The random number generator used by RANSAC.*/
     isaac_ctx isaac;
     /* current finder state, horizontal and vertical lines */
     qr_finder_lines finder_lines[2];
+    /* scratch memory for decoding the current image */
+    qr_arena arena;
+    /* character set converters for text extraction */
+    qr_iconv_cache iconv;
+    /* image scanner of the current decode (checked for its deadline) */
+    zbar_image_scanner_t *iscn;
+    /* start of the stage being timed for scan statistics */
+    unsigned long lap;
 };
 
 
-/*Initializes a client reader handle.*/
-static void qr_reader_init (qr_reader *reader)
+/*Allocates a client reader handle using the given shared tables.*/
+static qr_reader *qr_reader_alloc (qr_reader_tables *tables)
 {
-    /*time_t now;
-      now=time(NULL);
-      isaac_init(&_reader->isaac,&now,sizeof(now));*/
-    isaac_init(&reader->isaac, NULL, 0);
-    rs_gf256_init(&reader->gf, QR_PPOLY);
+    qr_reader *reader = (qr_reader*)calloc(1, sizeof(*reader));
+    if(!reader)
+        return(NULL);
+    _zbar_refcnt(&tables->refcnt, 1);
+    reader->tables = tables;
+    memcpy(&reader->isaac, &tables->isaac, sizeof(reader->isaac));
+    qr_arena_init(&reader->arena);
+    qr_iconv_cache_init(&reader->iconv);
+    return(reader);
 }
 
 /*Allocates a client reader handle.*/
 qr_reader *_zbar_qr_create (void)
 {
-    qr_reader *reader = (qr_reader*)calloc(1, sizeof(*reader));
-    qr_reader_init(reader);
+    qr_reader *reader;
+    qr_reader_tables *tables;
+    _zbar_refcnt_init();
+    tables = (qr_reader_tables*)calloc(1, sizeof(*tables));
+    if(!tables)
+        return(NULL);
+    /*time_t now;
+      now=time(NULL);
+      isaac_init(&_reader->isaac,&now,sizeof(now));*/
+    isaac_init(&tables->isaac, NULL, 0);
+    rs_gf256_init(&tables->gf, QR_PPOLY);
+    reader = qr_reader_alloc(tables);
+    if(!reader)
+        free(tables);
     return(reader);
 }
 
+/*Allocates a client reader handle sharing the tables of another.
+  The new reader starts from the same initial state as a created one.*/
+qr_reader *_zbar_qr_clone (const qr_reader *src)
+{
+    return(qr_reader_alloc(src->tables));
+}
+
 /*Frees a client reader handle.*/
 void _zbar_qr_destroy (qr_reader *reader)
 {
-    zprintf(1, "max finder lines = %dx%d\n",
+    zprintf(1, "max finder lines = %dx%d, scratch = %lu\n",
             reader->finder_lines[0].clines,
-            reader->finder_lines[1].clines);
+            reader->finder_lines[1].clines,
+            (unsigned long)reader->arena.size);
     if(reader->finder_lines[0].lines)
         free(reader->finder_lines[0].lines);
     if(reader->finder_lines[1].lines)
         free(reader->finder_lines[1].lines);
+    qr_arena_clear(&reader->arena);
+    qr_iconv_cache_clear(&reader->iconv);
+    if(!_zbar_refcnt(&reader->tables->refcnt, -1))
+        free(reader->tables);
     free(reader);
 }
 
@@ -107,6 +154,7 @@ void _zbar_qr_reset (qr_reader *reader)
 {
     reader->finder_lines[0].nlines = 0;
     reader->finder_lines[1].nlines = 0;
+    qr_arena_reset(&reader->arena);
 }
 
 
@@ -171,16 +219,18 @@ static int qr_finder_vline_cmp(const void *_a,const void *_b){
                with ties broken by Y coordinate.
   _nlines:    The number of lines in the set of lines to cluster.
   _v:         0 for horizontal lines, or 1 for vertical lines.
+  _arena:     The arena to allocate scratch space from.
   Return: The number of clusters.*/
 static int qr_finder_cluster_lines(qr_finder_cluster *_clusters,
- qr_finder_line **_neighbors,qr_finder_line *_lines,int _nlines,int _v){
+ qr_finder_line **_neighbors,qr_finder_line *_lines,int _nlines,int _v,
+ qr_arena *_arena){
   unsigned char   *mark;
   qr_finder_line **neighbors;
   int              nneighbors;
   int              nclusters;
   int              i;
   /*TODO: Kalman filters!*/
-  mark=(unsigned char *)calloc(_nlines,sizeof(*mark));
+  mark=(unsigned char *)qr_arena_calloc(_arena,_nlines,sizeof(*mark));
   neighbors=_neighbors;
   nclusters=0;
   for(i=0;i<_nlines-1;i++)if(!mark[i]){
@@ -230,7 +280,6 @@ static int qr_finder_cluster_lines(qr_finder_cluster *_clusters,
       nclusters++;
     }
   }
-  free(mark);
   return nclusters;
 }
 
@@ -302,10 +351,11 @@ static int qr_finder_lines_are_crossing(const qr_finder_line *_hline,
   _nhclusters: The number of horizontal line clusters.
   _vclusters:  The clusters of vertical lines crossing finder patterns.
   _nvclusters: The number of vertical line clusters.
+  _arena:      The arena to allocate scratch space from.
   Return: The number of putative finder centers.*/
 static int qr_finder_find_crossings(qr_finder_center *_centers,
  qr_finder_edge_pt *_edge_pts,qr_finder_cluster *_hclusters,int _nhclusters,
- qr_finder_cluster *_vclusters,int _nvclusters){
+ qr_finder_cluster *_vclusters,int _nvclusters,qr_arena *_arena){
   qr_finder_cluster **hneighbors;
   qr_finder_cluster **vneighbors;
   unsigned char      *hmark;
@@ -313,10 +363,12 @@ static int qr_finder_find_crossings(qr_finder_center *_centers,
   int                 ncenters;
   int                 i;
   int                 j;
-  hneighbors=(qr_finder_cluster **)malloc(_nhclusters*sizeof(*hneighbors));
-  vneighbors=(qr_finder_cluster **)malloc(_nvclusters*sizeof(*vneighbors));
-  hmark=(unsigned char *)calloc(_nhclusters,sizeof(*hmark));
-  vmark=(unsigned char *)calloc(_nvclusters,sizeof(*vmark));
+  hneighbors=(qr_finder_cluster **)qr_arena_alloc(_arena,
+   _nhclusters*sizeof(*hneighbors));
+  vneighbors=(qr_finder_cluster **)qr_arena_alloc(_arena,
+   _nvclusters*sizeof(*vneighbors));
+  hmark=(unsigned char *)qr_arena_calloc(_arena,_nhclusters,sizeof(*hmark));
+  vmark=(unsigned char *)qr_arena_calloc(_arena,_nvclusters,sizeof(*vmark));
   ncenters=0;
   /*TODO: This may need some re-working.
     We should be finding groups of clusters such that _all_ horizontal lines in
@@ -376,10 +428,6 @@ static int qr_finder_find_crossings(qr_finder_center *_centers,
       _edge_pts+=nedge_pts;
     }
   }
-  free(vmark);
-  free(hmark);
-  free(vneighbors);
-  free(hneighbors);
   /*Sort the centers by decreasing numbers of edge points.*/
   qsort(_centers,ncenters,sizeof(*_centers),qr_finder_center_cmp);
   return ncenters;
@@ -394,11 +442,10 @@ static int qr_finder_find_crossings(qr_finder_center *_centers,
    qr_finder_find_crossings() will filter most of them out.
   Where horizontal and vertical clusters cross, a prospective finder center is
    returned.
-  _centers:  Returns a pointer to a freshly-allocated list of finder centers.
-             This must be freed by the caller.
-  _edge_pts: Returns a pointer to a freshly-allocated list of edge points
-              around those centers.
-             This must be freed by the caller.
+  _centers:  Returns a pointer to a list of finder centers, allocated from the
+              reader's arena.
+  _edge_pts: Returns a pointer to a list of edge points around those centers,
+              allocated from the reader's arena.
   _img:      The binary image to search.
   _width:    The width of the image.
   _height:   The height of the image.
@@ -420,19 +467,25 @@ static int qr_finder_centers_locate(qr_finder_center **_centers,
   int                 ncenters;
 
   /*Cluster the detected lines.*/
-  hneighbors=(qr_finder_line **)malloc(nhlines*sizeof(*hneighbors));
+  hneighbors=(qr_finder_line **)qr_arena_alloc(&reader->arena,
+   nhlines*sizeof(*hneighbors));
   /*We require more than one line per cluster, so there are at most nhlines/2.*/
-  hclusters=(qr_finder_cluster *)malloc((nhlines>>1)*sizeof(*hclusters));
-  nhclusters=qr_finder_cluster_lines(hclusters,hneighbors,hlines,nhlines,0);
+  hclusters=(qr_finder_cluster *)qr_arena_alloc(&reader->arena,
+   (nhlines>>1)*sizeof(*hclusters));
+  nhclusters=qr_finder_cluster_lines(hclusters,hneighbors,hlines,nhlines,0,
+   &reader->arena);
   /*We need vertical lines to be sorted by X coordinate, with ties broken by Y
      coordinate, for clustering purposes.
     We scan the image in the opposite order for cache efficiency, so sort the
      lines we found here.*/
   qsort(vlines,nvlines,sizeof(*vlines),qr_finder_vline_cmp);
-  vneighbors=(qr_finder_line **)malloc(nvlines*sizeof(*vneighbors));
+  vneighbors=(qr_finder_line **)qr_arena_alloc(&reader->arena,
+   nvlines*sizeof(*vneighbors));
   /*We require more than one line per cluster, so there are at most nvlines/2.*/
-  vclusters=(qr_finder_cluster *)malloc((nvlines>>1)*sizeof(*vclusters));
-  nvclusters=qr_finder_cluster_lines(vclusters,vneighbors,vlines,nvlines,1);
+  vclusters=(qr_finder_cluster *)qr_arena_alloc(&reader->arena,
+   (nvlines>>1)*sizeof(*vclusters));
+  nvclusters=qr_finder_cluster_lines(vclusters,vneighbors,vlines,nvlines,1,
+   &reader->arena);
   /*Find line crossings among the clusters.*/
   if(nhclusters>=3&&nvclusters>=3){
     qr_finder_edge_pt  *edge_pts;
@@ -443,19 +496,16 @@ static int qr_finder_centers_locate(qr_finder_center **_centers,
     for(i=0;i<nhclusters;i++)nedge_pts+=hclusters[i].nlines;
     for(i=0;i<nvclusters;i++)nedge_pts+=vclusters[i].nlines;
     nedge_pts<<=1;
-    edge_pts=(qr_finder_edge_pt *)malloc(nedge_pts*sizeof(*edge_pts));
-    centers=(qr_finder_center *)malloc(
+    edge_pts=(qr_finder_edge_pt *)qr_arena_alloc(&reader->arena,
+     nedge_pts*sizeof(*edge_pts));
+    centers=(qr_finder_center *)qr_arena_alloc(&reader->arena,
      QR_MINI(nhclusters,nvclusters)*sizeof(*centers));
     ncenters=qr_finder_find_crossings(centers,edge_pts,
-     hclusters,nhclusters,vclusters,nvclusters);
+     hclusters,nhclusters,vclusters,nvclusters,&reader->arena);
     *_centers=centers;
     *_edge_pts=edge_pts;
   }
   else ncenters=0;
-  free(vclusters);
-  free(vneighbors);
-  free(hclusters);
-  free(hneighbors);
   return ncenters;
 }
 
@@ -3845,8 +3895,8 @@ static int qr_reader_try_configuration(qr_reader *_reader,
     }
     fmt_info=qr_finder_fmt_info_decode(&ul,&ur,&dl,&hom,_img,_width,_height);
     if(fmt_info<0||
-     qr_code_decode(_qrdata,&_reader->gf,ul.c->pos,ur.c->pos,dl.c->pos,
-     ur_version,fmt_info,_img,_width,_height)<0){
+     qr_code_decode(_qrdata,&_reader->tables->gf,ul.c->pos,ur.c->pos,
+     dl.c->pos,ur_version,fmt_info,_img,_width,_height)<0){
       /*The code may be flipped.
         Try again, swapping the UR and DL centers.
         We should get a valid version either way, so it's relatively cheap to
@@ -3871,8 +3921,8 @@ static int qr_reader_try_configuration(qr_reader *_reader,
       QR_SWAP2I(bbox[1][0],bbox[2][0]);
       QR_SWAP2I(bbox[1][1],bbox[2][1]);
       memcpy(_qrdata->bbox,bbox,sizeof(bbox));
-      if(qr_code_decode(_qrdata,&_reader->gf,ul.c->pos,dl.c->pos,ur.c->pos,
-       ur_version,fmt_info,_img,_width,_height)<0){
+      if(qr_code_decode(_qrdata,&_reader->tables->gf,ul.c->pos,dl.c->pos,
+       ur.c->pos,ur_version,fmt_info,_img,_width,_height)<0){
         continue;
       }
     }
@@ -3881,86 +3931,532 @@ static int qr_reader_try_configuration(qr_reader *_reader,
   return -1;
 }
 
-void qr_reader_match_centers(qr_reader *_reader,qr_code_data_list *_qrlist,
- qr_finder_center *_centers,int _ncenters,
- const unsigned char *_img,int _width,int _height){
-  /*The number of centers should be small, so an O(n^3) exhaustive search of
-     which ones go together should be reasonable.*/
-  unsigned char *mark;
-  int            nfailures_max;
-  int            nfailures;
-  int            i;
-  int            j;
-  int            k;
-  mark=(unsigned char *)calloc(_ncenters,sizeof(*mark));
-  nfailures_max=QR_MAXI(8192,_width*_height>>9);
-  nfailures=0;
+/*The log of the size of the square tiles the image is binarized in.*/
+#define QR_ROI_LOGTILE (5)
+
+/*A lazily binarized image.
+  Only the tiles a code built from some candidate triple of finder centers
+   could cover are thresholded; the rest of the mask stays 0 (light).*/
+typedef struct qr_roi_mask qr_roi_mask;
+
+struct qr_roi_mask{
+  /*The grayscale image.*/
+  const unsigned char *img;
+  /*The full-size binarized image.*/
+  unsigned char       *mask;
+  /*Scratch space for the binarizer.*/
+  unsigned            *col_sums;
+  /*Whether each tile has been binarized.*/
+  unsigned char       *tiles;
+  int                  width;
+  int                  height;
+  /*The number of bytes between rows of img.*/
+  int                  stride;
+  int                  twidth;
+  int                  theight;
+  /*The number of tiles not yet binarized.*/
+  int                  ntodo;
+};
+
+static void qr_roi_mask_init(qr_roi_mask *_roi,const unsigned char *_img,
+ int _width,int _height,int _stride,qr_arena *_arena){
+  _roi->img=_img;
+  _roi->width=_width;
+  _roi->height=_height;
+  _roi->stride=_stride;
+  _roi->twidth=(_width>>QR_ROI_LOGTILE)+1;
+  _roi->theight=(_height>>QR_ROI_LOGTILE)+1;
+  _roi->ntodo=_roi->twidth*_roi->theight;
+  _roi->mask=(unsigned char *)qr_arena_calloc(_arena,
+   _width*_height,sizeof(*_roi->mask));
+  _roi->tiles=(unsigned char *)qr_arena_calloc(_arena,
+   _roi->ntodo,sizeof(*_roi->tiles));
+  _roi->col_sums=(unsigned *)qr_arena_alloc(_arena,
+   _width*sizeof(*_roi->col_sums));
+}
+
+/*Binarizes the part of the image a code using the given finder centers could
+   cover, if it has not been already.
+  This is the bounding box of the centers and all three possible positions of
+   the fourth corner, padded by half the largest distance between centers to
+   allow for perspective and for the finder patterns themselves.*/
+static void qr_roi_mask_update(qr_roi_mask *_roi,qr_finder_center *_c[3]){
+  int bbox[2][2];
+  int pad;
+  int tx0;
+  int ty0;
+  int tx1;
+  int ty1;
+  int tx;
+  int ty;
+  int i;
+  int j;
+  if(_roi->ntodo<=0)return;
+  pad=0;
+  for(j=0;j<2;j++)bbox[j][0]=bbox[j][1]=_c[0]->pos[j];
+  for(i=0;i<3;i++){
+    qr_finder_center *ci;
+    qr_finder_center *cj;
+    qr_finder_center *ck;
+    ci=_c[i];
+    cj=_c[(i+1)%3];
+    ck=_c[(i+2)%3];
+    for(j=0;j<2;j++){
+      int p;
+      p=cj->pos[j]+ck->pos[j]-ci->pos[j];
+      bbox[j][0]=QR_MINI(bbox[j][0],QR_MINI(ci->pos[j],p));
+      bbox[j][1]=QR_MAXI(bbox[j][1],QR_MAXI(ci->pos[j],p));
+      pad=QR_MAXI(pad,abs(ci->pos[j]-cj->pos[j]));
+    }
+  }
+  pad>>=1;
+  tx0=QR_MAXI(0,bbox[0][0]-pad>>QR_FINDER_SUBPREC+QR_ROI_LOGTILE);
+  ty0=QR_MAXI(0,bbox[1][0]-pad>>QR_FINDER_SUBPREC+QR_ROI_LOGTILE);
+  tx1=QR_MINI(_roi->twidth,(bbox[0][1]+pad>>QR_FINDER_SUBPREC+QR_ROI_LOGTILE)+1);
+  ty1=QR_MINI(_roi->theight,(bbox[1][1]+pad>>QR_FINDER_SUBPREC+QR_ROI_LOGTILE)+1);
+  if(tx0>=tx1||ty0>=ty1)return;
+  /*Shrink the box to the tiles that still need binarizing.*/
+  {
+    int ux0;
+    int uy0;
+    int ux1;
+    int uy1;
+    ux0=tx1;
+    uy0=ty1;
+    ux1=uy1=-1;
+    for(ty=ty0;ty<ty1;ty++)for(tx=tx0;tx<tx1;tx++){
+      if(!_roi->tiles[ty*_roi->twidth+tx]){
+        ux0=QR_MINI(ux0,tx);
+        uy0=QR_MINI(uy0,ty);
+        ux1=QR_MAXI(ux1,tx);
+        uy1=QR_MAXI(uy1,ty);
+      }
+    }
+    if(ux1<0)return;
+    tx0=ux0;
+    ty0=uy0;
+    tx1=ux1+1;
+    ty1=uy1+1;
+  }
+  /*Once most of the image is needed, just finish all of it.*/
+  if((tx1-tx0)*(ty1-ty0)*2>=_roi->twidth*_roi->theight){
+    tx0=ty0=0;
+    tx1=_roi->twidth;
+    ty1=_roi->theight;
+  }
+  qr_binarize_rect(_roi->mask,_roi->img,_roi->width,_roi->height,_roi->stride,
+   tx0<<QR_ROI_LOGTILE,ty0<<QR_ROI_LOGTILE,
+   QR_MINI(tx1<<QR_ROI_LOGTILE,_roi->width),
+   QR_MINI(ty1<<QR_ROI_LOGTILE,_roi->height),_roi->col_sums);
+  for(ty=ty0;ty<ty1;ty++)for(tx=tx0;tx<tx1;tx++){
+    if(!_roi->tiles[ty*_roi->twidth+tx]){
+      _roi->tiles[ty*_roi->twidth+tx]=1;
+      _roi->ntodo--;
+    }
+  }
+}
+
+/*The largest ratio between the estimated sizes of two finder patterns that
+   are still considered part of the same code.
+  This has to allow for fairly strong perspective distortion.*/
+#define QR_FINDER_SIZE_RATIO (3)
+/*The maximum number of nearby finder centers paired with each center when
+   generating candidate configurations.*/
+#define QR_FINDER_NEIGHBORS_MAX (16)
+/*The width of a cell of the grid used to find nearby finder centers, in
+   units of the mean estimated finder size.
+  Adjacent corners of a version 1 code are about 5 finder sizes apart.*/
+#define QR_FINDER_CELL_SIZE (8)
+/*The number of failed configurations a finder center may take part in before
+   it is ignored.
+  Candidates are tried best first, so a real finder pattern almost always
+   succeeds well before this, while repetitive clutter that looks like a whole
+   field of plausible codes cannot exhaust the global failure limit.*/
+#define QR_FINDER_FAILURES_MAX (4)
+
+typedef struct qr_finder_triple qr_finder_triple;
+
+/*A candidate configuration of three finder centers.*/
+struct qr_finder_triple{
+  /*A penalty measuring how far the centers are from looking like the corners
+     of a code (smaller is better).*/
+  int score;
+  /*The indices of the three centers, in increasing order.*/
+  int c[3];
+};
+
+static int qr_finder_triple_cmp(const void *_a,const void *_b){
+  const qr_finder_triple *a;
+  const qr_finder_triple *b;
+  int                     i;
+  a=(const qr_finder_triple *)_a;
+  b=(const qr_finder_triple *)_b;
+  if(a->score!=b->score)return (a->score>b->score)-(a->score<b->score);
+  /*Break ties using the order of the original exhaustive search.*/
+  for(i=0;i<3;i++){
+    if(a->c[i]!=b->c[i])return (a->c[i]>b->c[i])-(a->c[i]<b->c[i]);
+  }
+  return 0;
+}
+
+/*Estimates the size of a finder pattern.
+  The edge points lie in the middle of the outer ring, about 3 modules from the
+   center along the line that found them (up to sqrt(2) times that when the
+   code is rotated).
+  Return: The mean distance of the edge points from the center, or 0 if there
+   are none.*/
+static int qr_finder_center_size(const qr_finder_center *_c){
+  int sum;
+  int i;
+  if(_c->nedge_pts<=0)return 0;
+  sum=0;
+  for(i=0;i<_c->nedge_pts;i++){
+    sum+=QR_MAXI(abs(_c->edge_pts[i].pos[0]-_c->pos[0]),
+     abs(_c->edge_pts[i].pos[1]-_c->pos[1]));
+  }
+  return (sum+(_c->nedge_pts>>1))/_c->nedge_pts;
+}
+
+/*Checks if two finder centers could be corners of the same code.
+  Adjacent corners are at least 14 modules apart, and opposite corners of a
+   version 40 code no more than about 240, which, together with the size
+   estimates, gives generous bounds on their distance.
+  _sa: The estimated size of the first finder pattern.
+  _sb: The estimated size of the second finder pattern.
+  Return: The distance between the centers, or 0 if they are incompatible.*/
+static unsigned qr_finder_pair_check(const qr_finder_center *_a,int _sa,
+ const qr_finder_center *_b,int _sb){
+  unsigned d;
+  unsigned smin;
+  unsigned smax;
+  d=qr_ihypot(_b->pos[0]-_a->pos[0],_b->pos[1]-_a->pos[1]);
+  /*Without an estimate of the size we can't say anything.*/
+  if(_sa<=0||_sb<=0)return d;
+  smin=QR_MINI(_sa,_sb);
+  smax=QR_MAXI(_sa,_sb);
+  if(smax>QR_FINDER_SIZE_RATIO*smin)return 0;
+  if(2*d<5*smin||d>96*smax)return 0;
+  return d;
+}
+
+/*Adds a center to a neighbor list sorted by distance, then index, keeping only
+   the first _nmax.
+  _n:    The neighbor indices.
+  _nd:   The neighbor distances.
+  _m:    The current number of neighbors.
+  _nmax: The size of the list.
+  _j:    The index of the new neighbor.
+  _d:    The distance of the new neighbor.
+  Return: The new number of neighbors.*/
+static int qr_finder_nbr_add(int *_n,unsigned *_nd,int _m,int _nmax,
+ int _j,unsigned _d){
+  int m;
+  m=_m;
+  if(m>=_nmax){
+    if(_d>_nd[_nmax-1]||_d==_nd[_nmax-1]&&_j>_n[_nmax-1])return _m;
+    m--;
+  }
+  else _m++;
+  for(;m>0&&(_nd[m-1]>_d||_nd[m-1]==_d&&_n[m-1]>_j);m--){
+    _n[m]=_n[m-1];
+    _nd[m]=_nd[m-1];
+  }
+  _n[m]=_j;
+  _nd[m]=_d;
+  return _m;
+}
+
+/*Lists the plausible configurations of three finder centers, best first.
+  Each center is paired only with the nearest centers of a compatible size,
+   and each triangle is counted once, at the corner opposite its longest side.
+  Triangles that are too flat or too lopsided to be the corners of a code
+   (even under perspective) are discarded, and the rest are ranked by how far
+   they are from a right isosceles triangle with equally sized finders.
+  _centers:  The finder centers.
+  _ncenters: The number of finder centers.
+  _triples:  Returns the list of candidates, allocated from the arena.
+  _arena:    The arena to allocate scratch space from.
+  Return: The number of candidates.*/
+static int qr_finder_triples_find(const qr_finder_center *_centers,
+ int _ncenters,qr_finder_triple **_triples,qr_arena *_arena){
+  qr_finder_triple *triples;
+  int              *sizes;
+  int              *nbrs;
+  unsigned         *nbrd;
+  int              *nnbrs;
+  int              *cells;
+  int              *order;
+  long long         ssum;
+  int               nsized;
+  int               xmin;
+  int               xmax;
+  int               ymin;
+  int               ymax;
+  int               cell;
+  int               gw;
+  int               gh;
+  int               nmax;
+  int               ntriples;
+  int               i;
+  int               j;
+  int               k;
+  nmax=QR_MINI(QR_FINDER_NEIGHBORS_MAX,_ncenters-1);
+  if(nmax<2){
+    *_triples=NULL;
+    return 0;
+  }
+  sizes=(int *)qr_arena_alloc(_arena,_ncenters*sizeof(*sizes));
+  nbrs=(int *)qr_arena_alloc(_arena,_ncenters*nmax*sizeof(*nbrs));
+  nbrd=(unsigned *)qr_arena_alloc(_arena,_ncenters*nmax*sizeof(*nbrd));
+  nnbrs=(int *)qr_arena_calloc(_arena,_ncenters,sizeof(*nnbrs));
+  /*Bucket the centers on a grid with cells a few finders wide.*/
+  xmin=xmax=_centers[0].pos[0];
+  ymin=ymax=_centers[0].pos[1];
+  ssum=0;
+  nsized=0;
+  for(i=0;i<_ncenters;i++){
+    sizes[i]=qr_finder_center_size(_centers+i);
+    if(sizes[i]>0){
+      ssum+=sizes[i];
+      nsized++;
+    }
+    xmin=QR_MINI(xmin,_centers[i].pos[0]);
+    xmax=QR_MAXI(xmax,_centers[i].pos[0]);
+    ymin=QR_MINI(ymin,_centers[i].pos[1]);
+    ymax=QR_MAXI(ymax,_centers[i].pos[1]);
+  }
+  cell=nsized>0?QR_FINDER_CELL_SIZE*(int)(ssum/nsized):1;
+  cell=QR_MAXI(cell,1);
+  /*Don't use (many) more cells than centers.*/
+  for(;;){
+    gw=(xmax-xmin)/cell+1;
+    gh=(ymax-ymin)/cell+1;
+    if((long long)gw*gh<=4*(long long)_ncenters)break;
+    cell<<=1;
+  }
+  cells=(int *)qr_arena_calloc(_arena,gw*gh+1,sizeof(*cells));
+  order=(int *)qr_arena_alloc(_arena,_ncenters*sizeof(*order));
+  for(i=0;i<_ncenters;i++){
+    cells[((_centers[i].pos[1]-ymin)/cell)*gw+
+     (_centers[i].pos[0]-xmin)/cell+1]++;
+  }
+  for(i=0;i<gw*gh;i++)cells[i+1]+=cells[i];
+  /*Counting sort, so each cell lists its centers in index order.*/
   for(i=0;i<_ncenters;i++){
-    /*TODO: We might be able to accelerate this step significantly by
-       considering the remaining finder centers in a more intelligent order,
-       based on the first finder center we just chose.*/
-    for(j=i+1;!mark[i]&&j<_ncenters;j++){
-      for(k=j+1;!mark[j]&&k<_ncenters;k++)if(!mark[k]){
-        qr_finder_center *c[3];
-        qr_code_data      qrdata;
-        int               version;
-        c[0]=_centers+i;
-        c[1]=_centers+j;
-        c[2]=_centers+k;
-        version=qr_reader_try_configuration(_reader,&qrdata,
-         _img,_width,_height,c);
-        if(version>=0){
-          int ninside;
+    order[cells[((_centers[i].pos[1]-ymin)/cell)*gw+
+     (_centers[i].pos[0]-xmin)/cell]++]=i;
+  }
+  for(i=gw*gh;i>0;i--)cells[i]=cells[i-1];
+  cells[0]=0;
+  /*Keep the nearest compatible neighbors of each center, sorted by distance,
+     searching rings of cells outward until no closer center can remain.*/
+  for(i=0;i<_ncenters;i++){
+    unsigned dmax;
+    int      gx;
+    int      gy;
+    int      r;
+    int      rmax;
+    gx=(_centers[i].pos[0]-xmin)/cell;
+    gy=(_centers[i].pos[1]-ymin)/cell;
+    rmax=QR_MAXI(QR_MAXI(gx,gw-1-gx),QR_MAXI(gy,gh-1-gy));
+    /*Compatible centers are no more than 96 times the larger size apart, and
+       that is at most 3 times this size (unless some size is unknown).*/
+    dmax=sizes[i]>0&&nsized==_ncenters?
+     96*QR_FINDER_SIZE_RATIO*(unsigned)sizes[i]:UINT_MAX;
+    for(r=0;r<=rmax;r++){
+      int x;
+      int y;
+      /*Every center in this ring is at least (r-1)*cell away (and qr_ihypot()
+         may round down by 1).*/
+      if(r>1){
+        unsigned dr;
+        dr=(unsigned)(r-1)*cell;
+        if(dr>dmax+1)break;
+        if(nnbrs[i]>=nmax&&nbrd[i*nmax+nmax-1]+1<dr)break;
+      }
+      for(y=QR_MAXI(gy-r,0);y<=QR_MINI(gy+r,gh-1);y++){
+        int dx;
+        /*Only the left and right columns of the ring away from the top and
+           bottom rows.*/
+        dx=y==gy-r||y==gy+r?1:2*r;
+        for(x=gx-r;x<=gx+r;x+=QR_MAXI(dx,1)){
           int l;
-          /*Add the data to the list.*/
-          qr_code_data_list_add(_qrlist,&qrdata);
-          /*Convert the bounding box we're returning to the user to normal
-             image coordinates.*/
-          for(l=0;l<4;l++){
-            _qrlist->qrdata[_qrlist->nqrdata-1].bbox[l][0]>>=QR_FINDER_SUBPREC;
-            _qrlist->qrdata[_qrlist->nqrdata-1].bbox[l][1]>>=QR_FINDER_SUBPREC;
-          }
-          /*Mark these centers as used.*/
-          mark[i]=mark[j]=mark[k]=1;
-          /*Find any other finder centers located inside this code.*/
-          for(l=ninside=0;l<_ncenters;l++)if(!mark[l]){
-            if(qr_point_ccw(qrdata.bbox[0],qrdata.bbox[1],_centers[l].pos)>=0&&
-             qr_point_ccw(qrdata.bbox[1],qrdata.bbox[3],_centers[l].pos)>=0&&
-             qr_point_ccw(qrdata.bbox[3],qrdata.bbox[2],_centers[l].pos)>=0&&
-             qr_point_ccw(qrdata.bbox[2],qrdata.bbox[0],_centers[l].pos)>=0){
-              mark[l]=2;
-              ninside++;
-            }
-          }
-          if(ninside>=3){
-            /*We might have a "Double QR": a code inside a code.
-              Copy the relevant centers to a new array and do a search confined
-               to that subset.*/
-            qr_finder_center *inside;
-            inside=(qr_finder_center *)malloc(ninside*sizeof(*inside));
-            for(l=ninside=0;l<_ncenters;l++){
-              if(mark[l]==2)*&inside[ninside++]=*&_centers[l];
+          if(x<0||x>=gw)continue;
+          for(l=cells[y*gw+x];l<cells[y*gw+x+1];l++){
+            unsigned d;
+            j=order[l];
+            if(j==i)continue;
+            d=qr_finder_pair_check(_centers+i,sizes[i],_centers+j,sizes[j]);
+            if(d>0){
+              nnbrs[i]=qr_finder_nbr_add(nbrs+i*nmax,nbrd+i*nmax,nnbrs[i],
+               nmax,j,d);
             }
-            qr_reader_match_centers(_reader,_qrlist,inside,ninside,
-             _img,_width,_height);
-            free(inside);
           }
-          /*Mark _all_ such centers used: codes cannot partially overlap.*/
-          for(l=0;l<_ncenters;l++)if(mark[l]==2)mark[l]=1;
-          nfailures=0;
         }
-        else if(++nfailures>nfailures_max){
-          /*Give up.
-            We're unlikely to find a valid code in all this clutter, and we
-             could spent quite a lot of time trying.*/
-          i=j=k=_ncenters;
+      }
+    }
+  }
+  triples=(qr_finder_triple *)qr_arena_alloc(_arena,
+   _ncenters*(nmax*(nmax-1)>>1)*sizeof(*triples));
+  ntriples=0;
+  for(i=0;i<_ncenters;i++){
+    const int      *n;
+    const unsigned *nd;
+    n=nbrs+i*nmax;
+    nd=nbrd+i*nmax;
+    for(j=0;j<nnbrs[i];j++)for(k=j+1;k<nnbrs[i];k++){
+      qr_finder_triple *t;
+      long long         dot;
+      unsigned          a;
+      unsigned          b;
+      unsigned          c;
+      int               smin;
+      int               smax;
+      int               score;
+      int               l;
+      c=qr_finder_pair_check(_centers+n[j],sizes[n[j]],
+       _centers+n[k],sizes[n[k]]);
+      if(c<=0)continue;
+      /*Only count the triangle at the corner opposite its longest side
+         (breaking ties by index).*/
+      a=nd[j];
+      b=nd[k];
+      if(c<a||c==a&&n[k]<i||c<b||c==b&&n[j]<i)continue;
+      /*Reject lopsided triangles.*/
+      if(QR_MAXI(a,b)>4*QR_MINI(a,b))continue;
+      /*The angle here is at least 60 degrees; reject anything wider than
+         about 140.*/
+      dot=(_centers[n[j]].pos[0]-_centers[i].pos[0])*
+       (long long)(_centers[n[k]].pos[0]-_centers[i].pos[0])+
+       (_centers[n[j]].pos[1]-_centers[i].pos[1])*
+       (long long)(_centers[n[k]].pos[1]-_centers[i].pos[1]);
+      if(dot<0&&-4*dot>3*(long long)a*b)continue;
+      /*Penalize the cosine of the angle, the ratio of the two sides, and the
+         ratio of the finder sizes, each scaled to [0,256].*/
+      score=(int)(((dot<0?-dot:dot)<<8)/((long long)a*b));
+      score+=(int)(((long long)QR_MAXI(a,b)-QR_MINI(a,b)<<8)/QR_MAXI(a,b));
+      smin=QR_MINI(sizes[i],QR_MINI(sizes[n[j]],sizes[n[k]]));
+      smax=QR_MAXI(sizes[i],QR_MAXI(sizes[n[j]],sizes[n[k]]));
+      score+=smin>0?(smax-smin<<8)/smax:128;
+      t=triples+ntriples++;
+      t->score=score;
+      t->c[0]=i;
+      t->c[1]=n[j];
+      t->c[2]=n[k];
+      for(l=0;l<2;l++){
+        QR_SORT2I(t->c[0],t->c[1]);
+        QR_SORT2I(t->c[1],t->c[2]);
+      }
+    }
+  }
+  qsort(triples,ntriples,sizeof(*triples),qr_finder_triple_cmp);
+  *_triples=triples;
+  return ntriples;
+}
+
+void qr_reader_match_centers(qr_reader *_reader,qr_code_data_list *_qrlist,
+ qr_finder_center *_centers,int _ncenters,qr_roi_mask *_roi){
+  qr_finder_triple *triples;
+  unsigned char    *mark;
+  unsigned char    *nfails;
+  int               ntriples;
+  int               nfailures_max;
+  int               nfailures;
+  int               ti;
+  mark=(unsigned char *)qr_arena_calloc(&_reader->arena,
+   _ncenters,sizeof(*mark));
+  nfails=(unsigned char *)qr_arena_calloc(&_reader->arena,
+   _ncenters,sizeof(*nfails));
+  /*Rather than an exhaustive O(n^3) search of which centers go together,
+     only try the geometrically plausible ones, most promising first.*/
+  ntriples=qr_finder_triples_find(_centers,_ncenters,&triples,&_reader->arena);
+  nfailures_max=QR_MAXI(8192,_roi->width*_roi->height>>9);
+  nfailures=0;
+  for(ti=0;ti<ntriples;ti++){
+    qr_finder_center *c[3];
+    qr_code_data      qrdata;
+    int               version;
+    int               i;
+    int               j;
+    int               k;
+    i=triples[ti].c[0];
+    j=triples[ti].c[1];
+    k=triples[ti].c[2];
+    if(mark[i]||mark[j]||mark[k])continue;
+    /*Stop trying candidates once the scan is out of time or has found
+       enough codes.*/
+    if(_zbar_image_scanner_stopped(_reader->iscn)||
+     _zbar_image_scanner_satisfied(_reader->iscn,ZBAR_QRCODE,
+     _qrlist->nqrdata)){
+      break;
+    }
+    if(nfails[i]>=QR_FINDER_FAILURES_MAX||nfails[j]>=QR_FINDER_FAILURES_MAX||
+     nfails[k]>=QR_FINDER_FAILURES_MAX){
+      continue;
+    }
+    c[0]=_centers+i;
+    c[1]=_centers+j;
+    c[2]=_centers+k;
+    _zbar_image_scanner_lap(_reader->iscn,SCAN_STAGE_QR_DECODE,&_reader->lap);
+    qr_roi_mask_update(_roi,c);
+    _zbar_image_scanner_lap(_reader->iscn,SCAN_STAGE_QR_BINARIZE,
+     &_reader->lap);
+    version=qr_reader_try_configuration(_reader,&qrdata,
+     _roi->mask,_roi->width,_roi->height,c);
+    if(version>=0){
+      int ninside;
+      int l;
+      /*Add the data to the list.*/
+      qr_code_data_list_add(_qrlist,&qrdata);
+      /*Convert the bounding box we're returning to the user to normal
+         image coordinates.*/
+      for(l=0;l<4;l++){
+        _qrlist->qrdata[_qrlist->nqrdata-1].bbox[l][0]>>=QR_FINDER_SUBPREC;
+        _qrlist->qrdata[_qrlist->nqrdata-1].bbox[l][1]>>=QR_FINDER_SUBPREC;
+      }
+      /*Mark these centers as used.*/
+      mark[i]=mark[j]=mark[k]=1;
+      /*Find any other finder centers located inside this code.*/
+      for(l=ninside=0;l<_ncenters;l++)if(!mark[l]){
+        if(qr_point_ccw(qrdata.bbox[0],qrdata.bbox[1],_centers[l].pos)>=0&&
+         qr_point_ccw(qrdata.bbox[1],qrdata.bbox[3],_centers[l].pos)>=0&&
+         qr_point_ccw(qrdata.bbox[3],qrdata.bbox[2],_centers[l].pos)>=0&&
+         qr_point_ccw(qrdata.bbox[2],qrdata.bbox[0],_centers[l].pos)>=0){
+          mark[l]=2;
+          ninside++;
+        }
+      }
+      if(ninside>=3){
+        /*We might have a "Double QR": a code inside a code.
+          Copy the relevant centers to a new array and do a search confined
+           to that subset.*/
+        qr_finder_center *inside;
+        inside=(qr_finder_center *)qr_arena_alloc(&_reader->arena,
+         ninside*sizeof(*inside));
+        for(l=ninside=0;l<_ncenters;l++){
+          if(mark[l]==2)*&inside[ninside++]=*&_centers[l];
         }
+        qr_reader_match_centers(_reader,_qrlist,inside,ninside,_roi);
+      }
+      /*Mark _all_ such centers used: codes cannot partially overlap.*/
+      for(l=0;l<_ncenters;l++)if(mark[l]==2)mark[l]=1;
+      nfailures=0;
+    }
+    else{
+      nfails[i]++;
+      nfails[j]++;
+      nfails[k]++;
+      if(++nfailures>nfailures_max){
+        /*Give up.
+          We're unlikely to find a valid code in all this clutter, and we
+           could spent quite a lot of time trying.*/
+        break;
       }
     }
   }
-  free(mark);
 }
 
+
 int _zbar_qr_found_line (qr_reader *reader,
                          int dir,
                          const qr_finder_line *line)
@@ -4007,12 +4503,17 @@ int _zbar_qr_decode (qr_reader *reader,
     qr_finder_center *centers = NULL;
 
     if(reader->finder_lines[0].nlines < 9 ||
-       reader->finder_lines[1].nlines < 9)
+       reader->finder_lines[1].nlines < 9 ||
+       _zbar_image_scanner_stopped(iscn))
         return(0);
 
     svg_group_start("finder", 0, 1. / (1 << QR_FINDER_SUBPREC), 0, 0, 0);
 
+    reader->iscn = iscn;
+    _zbar_image_scanner_lap(iscn, SCAN_STAGE_START, &reader->lap);
+    /* scratch allocations are released by the next _zbar_qr_reset() */
     ncenters = qr_finder_centers_locate(&centers, &edge_pts, reader, 0, 0);
+    _zbar_image_scanner_lap(iscn, SCAN_STAGE_QR_LOCATE, &reader->lap);
 
     zprintf(14, "%dx%d finders, %d centers:\n",
             reader->finder_lines[0].nlines,
@@ -4020,26 +4521,42 @@ int _zbar_qr_decode (qr_reader *reader,
             ncenters);
     qr_svg_centers(centers, ncenters);
 
-    if(ncenters >= 3) {
-        void *bin = qr_binarize(img->data, img->width, img->height);
+    if(ncenters >= 3 && !_zbar_image_scanner_stopped(iscn)) {
+        unsigned w = img->width, h = img->height, step, stride;
+        const unsigned char *luma = _zbar_image_get_luma(img, &step, &stride);
+        if(!luma) {
+            svg_group_end();
+            return(0);
+        }
+        if(step != 1) {
+            /* binarizer needs contiguous luma samples */
+            unsigned char *dst = qr_arena_alloc(&reader->arena, w * h);
+            unsigned x, y;
+            for(y = 0; y < h; y++)
+                for(x = 0; x < w; x++)
+                    dst[y * w + x] = luma[y * stride + x * step];
+            luma = dst;
+            stride = w;
+        }
+
+        /* binarize only around candidate codes */
+        qr_roi_mask roi;
+        qr_roi_mask_init(&roi, luma, w, h, stride, &reader->arena);
 
         qr_code_data_list qrlist;
         qr_code_data_list_init(&qrlist);
 
-        qr_reader_match_centers(reader, &qrlist, centers, ncenters,
-                                bin, img->width, img->height);
+        qr_reader_match_centers(reader, &qrlist, centers, ncenters, &roi);
 
         if(qrlist.nqrdata > 0)
-            nqrdata = qr_code_data_list_extract_text(&qrlist, iscn, img);
+            nqrdata = qr_code_data_list_extract_text(&qrlist, iscn, img,
+                                                     &reader->arena,
+                                                     &reader->iconv);
 
         qr_code_data_list_clear(&qrlist);
-        free(bin);
+        _zbar_image_scanner_lap(iscn, SCAN_STAGE_QR_DECODE, &reader->lap);
     }
     svg_group_end();
 
-    if(centers)
-        free(centers);
-    if(edge_pts)
-        free(edge_pts);
     return(nqrdata);
 }
@@ -6,11 +6,14 @@
 #if !defined(_qrdec_H)
 # define _qrdec_H (1)
 
+#include <iconv.h>
 #include <zbar.h>
+#include "util.h"
 
 typedef struct qr_code_data_entry qr_code_data_entry;
 typedef struct qr_code_data       qr_code_data;
 typedef struct qr_code_data_list  qr_code_data_list;
+typedef struct qr_iconv_cache     qr_iconv_cache;
 
 typedef enum qr_mode{
   /*Numeric digits ('0'...'9').*/
@@ -151,6 +154,23 @@ struct qr_code_data_list{
 };
 
 
+/*The iconv() converters used for text extraction.
+  These are opened on first use and kept until the reader is destroyed, since
+   iconv_open() can cost more than decoding a small code.
+  ASCII, UTF-8 and ISO-8859-1 are converted without iconv().*/
+struct qr_iconv_cache{
+  /*SJIS to UTF-8, or (iconv_t)-1 if not available.*/
+  iconv_t sjis_cd;
+  int     sjis_opened;
+  /*The converter for the last ECI designator that needed one.*/
+  iconv_t eci_cd;
+  int     eci;
+};
+
+void qr_iconv_cache_init(qr_iconv_cache *_cache);
+void qr_iconv_cache_clear(qr_iconv_cache *_cache);
+
+
 /*Extract symbol data from a list of QR codes and attach to the image.
   All text is converted to UTF-8.
   Any structured-append group that does not have all of its members is decoded
@@ -158,11 +178,14 @@ struct qr_code_data_list{
   Note that isolated members of a structured-append group may be decoded with
    the wrong character set, since the correct setting cannot be propagated
    between codes.
+  Scratch memory is allocated from _arena, and converters come from _cache.
   Return: The number of symbols which were successfully extracted from the
    codes; this will be at most the number of codes.*/
 int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
                                    zbar_image_scanner_t *iscn,
-                                   zbar_image_t *img);
+                                   zbar_image_t *img,
+                                   qr_arena *_arena,
+                                   qr_iconv_cache *_cache);
 
 
 /*TODO: Parse DoCoMo standard barcode data formats.
@@ -32,7 +32,148 @@ static int text_is_latin1(const unsigned char *_text,int _len){
   return 1;
 }
 
-static void enc_list_mtf(iconv_t _enc_list[3],iconv_t _enc){
+/*The character sets text is converted from.*/
+#define QR_ENC_SJIS   (0)
+#define QR_ENC_LATIN1 (1)
+#define QR_ENC_UTF8   (2)
+/*Whatever the cached ECI converter handles.*/
+#define QR_ENC_ECI    (3)
+
+void qr_iconv_cache_init(qr_iconv_cache *_cache){
+  _cache->sjis_cd=(iconv_t)-1;
+  _cache->sjis_opened=0;
+  _cache->eci_cd=(iconv_t)-1;
+  _cache->eci=-1;
+}
+
+void qr_iconv_cache_clear(qr_iconv_cache *_cache){
+  if(_cache->sjis_cd!=(iconv_t)-1)iconv_close(_cache->sjis_cd);
+  if(_cache->eci_cd!=(iconv_t)-1)iconv_close(_cache->eci_cd);
+}
+
+static iconv_t qr_iconv_cache_sjis(qr_iconv_cache *_cache){
+  if(!_cache->sjis_opened){
+    _cache->sjis_cd=iconv_open("UTF-8","SJIS");
+    _cache->sjis_opened=1;
+  }
+  return _cache->sjis_cd;
+}
+
+/*Returns the converter from _enc, reusing the cached one if it was opened for
+   the same ECI designator.
+  A failure to open is cached, too.*/
+static iconv_t qr_iconv_cache_eci(qr_iconv_cache *_cache,int _eci,
+ const char *_enc){
+  if(_cache->eci!=_eci){
+    if(_cache->eci_cd!=(iconv_t)-1)iconv_close(_cache->eci_cd);
+    _cache->eci_cd=iconv_open("UTF-8",_enc);
+    _cache->eci=_eci;
+  }
+  return _cache->eci_cd;
+}
+
+/*Converts ISO-8859-1 text to UTF-8.
+  Every byte is valid, and maps directly to the code point with that value.*/
+static int qr_latin1_to_utf8(char **_in,size_t *_inleft,
+ char **_out,size_t *_outleft){
+  const unsigned char *in;
+  unsigned char       *out;
+  size_t               inleft;
+  size_t               outleft;
+  in=(const unsigned char *)*_in;
+  out=(unsigned char *)*_out;
+  inleft=*_inleft;
+  outleft=*_outleft;
+  for(;inleft>0;inleft--){
+    unsigned c;
+    c=*in++;
+    if(c<0x80){
+      if(outleft<1)return -1;
+      *out++=(unsigned char)c;
+      outleft--;
+    }
+    else{
+      if(outleft<2)return -1;
+      *out++=(unsigned char)(0xC0|c>>6);
+      *out++=(unsigned char)(0x80|c&0x3F);
+      outleft-=2;
+    }
+  }
+  *_in=(char *)in;
+  *_inleft=inleft;
+  *_out=(char *)out;
+  *_outleft=outleft;
+  return 0;
+}
+
+/*Copies UTF-8 text, checking that it is well-formed (RFC 3629: no overlong
+   forms, surrogates, or code points past U+10FFFF).*/
+static int qr_utf8_copy(char **_in,size_t *_inleft,
+ char **_out,size_t *_outleft){
+  const unsigned char *in;
+  size_t               inleft;
+  size_t               i;
+  in=(const unsigned char *)*_in;
+  inleft=*_inleft;
+  if(inleft>*_outleft)return -1;
+  for(i=0;i<inleft;){
+    unsigned c;
+    unsigned lo;
+    unsigned hi;
+    int      n;
+    int      j;
+    c=in[i];
+    if(c<0x80){
+      i++;
+      continue;
+    }
+    lo=0x80;
+    hi=0xBF;
+    if(c>=0xC2&&c<=0xDF)n=1;
+    else if(c>=0xE0&&c<=0xEF){
+      n=2;
+      if(c==0xE0)lo=0xA0;
+      else if(c==0xED)hi=0x9F;
+    }
+    else if(c>=0xF0&&c<=0xF4){
+      n=3;
+      if(c==0xF0)lo=0x90;
+      else if(c==0xF4)hi=0x8F;
+    }
+    else return -1;
+    if(inleft-i<=(size_t)n)return -1;
+    /*Only the first continuation byte has a restricted range.*/
+    if(in[i+1]<lo||in[i+1]>hi)return -1;
+    for(j=2;j<=n;j++)if((in[i+j]&0xC0)!=0x80)return -1;
+    i+=n+1;
+  }
+  memcpy(*_out,in,inleft);
+  *_in+=inleft;
+  *_inleft=0;
+  *_out+=inleft;
+  *_outleft-=inleft;
+  return 0;
+}
+
+/*Converts text in the given character set to UTF-8.
+  Return: 0 on success, or -1 if the text was invalid, did not fit, or no
+   converter was available.*/
+static int qr_text_convert(qr_iconv_cache *_cache,int _enc,
+ char **_in,size_t *_inleft,char **_out,size_t *_outleft){
+  iconv_t cd;
+  switch(_enc){
+    case QR_ENC_LATIN1:return qr_latin1_to_utf8(_in,_inleft,_out,_outleft);
+    case QR_ENC_UTF8:return qr_utf8_copy(_in,_inleft,_out,_outleft);
+    case QR_ENC_SJIS:cd=qr_iconv_cache_sjis(_cache);break;
+    default:cd=_cache->eci_cd;break;
+  }
+  if(cd==(iconv_t)-1)return -1;
+  /*Clear any shift state left over from a failed conversion.*/
+  iconv(cd,NULL,NULL,NULL,NULL);
+  return iconv(cd,_in,_inleft,_out,_outleft)==(size_t)-1?-1:0;
+}
+
+static void enc_list_mtf(int _enc_list[3],int _enc){
   int i;
   for(i=0;i<3;i++)if(_enc_list[i]==_enc){
     int j;
@@ -44,11 +185,10 @@ static void enc_list_mtf(iconv_t _enc_list[3],iconv_t _enc){
 
 int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
                                    zbar_image_scanner_t *iscn,
-                                   zbar_image_t *img)
+                                   zbar_image_t *img,
+                                   qr_arena *_arena,
+                                   qr_iconv_cache *_cache)
 {
-  iconv_t              sjis_cd;
-  iconv_t              utf8_cd;
-  iconv_t              latin1_cd;
   const qr_code_data  *qrdata;
   int                  nqrdata;
   unsigned char       *mark;
@@ -56,19 +196,13 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
   int                  i;
   qrdata=_qrlist->qrdata;
   nqrdata=_qrlist->nqrdata;
-  mark=(unsigned char *)calloc(nqrdata,sizeof(*mark));
+  mark=(unsigned char *)qr_arena_calloc(_arena,nqrdata,sizeof(*mark));
   ntext=0;
-  /*This is the encoding the standard says is the default.*/
-  latin1_cd=iconv_open("UTF-8","ISO8859-1");
-  /*But this one is often used, as well.*/
-  sjis_cd=iconv_open("UTF-8","SJIS");
-  /*This is a trivial conversion just to check validity without extra code.*/
-  utf8_cd=iconv_open("UTF-8","UTF-8");
   for(i=0;i<nqrdata;i++)if(!mark[i]){
     const qr_code_data       *qrdataj;
     const qr_code_data_entry *entry;
-    iconv_t                   enc_list[3];
-    iconv_t                   eci_cd;
+    int                       enc_list[3];
+    int                       eci_enc;
     int                       sa[16];
     int                       sa_size;
     char                     *sa_text;
@@ -160,10 +294,12 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
       else sa_text[sa_ntext++]=(char)(fnc1_2ai-100);
     }
     eci=-1;
-    enc_list[0]=sjis_cd;
-    enc_list[1]=latin1_cd;
-    enc_list[2]=utf8_cd;
-    eci_cd=(iconv_t)-1;
+    /*ISO-8859-1 is the encoding the standard says is the default, but SJIS is
+       often used, as well.*/
+    enc_list[0]=QR_ENC_SJIS;
+    enc_list[1]=QR_ENC_LATIN1;
+    enc_list[2]=QR_ENC_UTF8;
+    eci_enc=QR_ENC_ECI;
     err=0;
     for(j = 0; j < sa_size && !err; j++, sym = &(*sym)->next) {
       *sym = _zbar_image_scanner_alloc_sym(iscn, ZBAR_QRCODE, 0);
@@ -264,7 +400,7 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
             if(eci<0){
               int ei;
               /*If there was data encoded in kanji mode, assume it's SJIS.*/
-              if(has_kanji)enc_list_mtf(enc_list,sjis_cd);
+              if(has_kanji)enc_list_mtf(enc_list,QR_ENC_SJIS);
               /*Otherwise check for the UTF-8 BOM.
                 UTF-8 is rarely specified with ECI, and few decoders
                  currently support doing so, so this is the best way for
@@ -274,11 +410,10 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
                 in+=3;
                 inleft-=3;
                 /*Actually try converting (to check validity).*/
-                err=utf8_cd==(iconv_t)-1||
-                 iconv(utf8_cd,&in,&inleft,&out,&outleft)==(size_t)-1;
+                err=qr_utf8_copy(&in,&inleft,&out,&outleft)<0;
                 if(!err){
                   sa_ntext=out-sa_text;
-                  enc_list_mtf(enc_list,utf8_cd);
+                  enc_list_mtf(enc_list,QR_ENC_UTF8);
                   continue;
                 }
                 in=(char *)entry->payload.data.buf;
@@ -289,10 +424,10 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
               /*If the text is 8-bit clean, prefer UTF-8 over SJIS, since
                  SJIS will corrupt the backslashes used for DoCoMo formats.*/
               else if(text_is_ascii((unsigned char *)in,inleft)){
-                enc_list_mtf(enc_list,utf8_cd);
+                enc_list_mtf(enc_list,QR_ENC_UTF8);
               }
               /*Try our list of encodings.*/
-              for(ei=0;ei<3;ei++)if(enc_list[ei]!=(iconv_t)-1){
+              for(ei=0;ei<3;ei++){
                 /*According to the 2005 version of the standard,
                    ISO/IEC 8859-1 (one hyphen) is supposed to be used, but
                    reality is not always so (and in the 2000 version of the
@@ -304,13 +439,14 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
                    number of seldom-used control code characters there.
                   So if we see any of those characters, move this
                    conversion to the end of the list.*/
-                if(ei<2&&enc_list[ei]==latin1_cd&&
+                if(ei<2&&enc_list[ei]==QR_ENC_LATIN1&&
                  !text_is_latin1((unsigned char *)in,inleft)){
                   int ej;
                   for(ej=ei+1;ej<3;ej++)enc_list[ej-1]=enc_list[ej];
-                  enc_list[2]=latin1_cd;
+                  enc_list[2]=QR_ENC_LATIN1;
                 }
-                err=iconv(enc_list[ei],&in,&inleft,&out,&outleft)==(size_t)-1;
+                err=qr_text_convert(_cache,enc_list[ei],
+                 &in,&inleft,&out,&outleft)<0;
                 if(!err){
                   sa_ntext=out-sa_text;
                   enc_list_mtf(enc_list,enc_list[ei]);
@@ -327,8 +463,8 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
                came from the given character set even when encoded in kanji
                mode.*/
             else{
-              err=eci_cd==(iconv_t)-1||
-               iconv(eci_cd,&in,&inleft,&out,&outleft)==(size_t)-1;
+              err=qr_text_convert(_cache,eci_enc,
+               &in,&inleft,&out,&outleft)<0;
               if(!err)sa_ntext=out-sa_text;
             }
           }break;
@@ -353,19 +489,21 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
                we recognize.*/
             else continue;
             eci=cur_eci;
-            eci_cd=iconv_open("UTF-8",enc);
+            if(!strcmp(enc,"ISO8859-1"))eci_enc=QR_ENC_LATIN1;
+            else if(cur_eci==QR_ECI_UTF8)eci_enc=QR_ENC_UTF8;
+            else if(cur_eci==QR_ECI_SJIS)eci_enc=QR_ENC_SJIS;
+            else{
+              qr_iconv_cache_eci(_cache,cur_eci,enc);
+              eci_enc=QR_ENC_ECI;
+            }
           }break;
           /*Silence stupid compiler warnings.*/
           default:break;
         }
       }
       /*If eci should be reset between codes, do so.*/
-      if(eci<=QR_ECI_GLI1){
-        eci=-1;
-        if(eci_cd!=(iconv_t)-1)iconv_close(eci_cd);
-      }
+      if(eci<=QR_ECI_GLI1)eci=-1;
     }
-    if(eci_cd!=(iconv_t)-1)iconv_close(eci_cd);
     if(!err){
       zbar_symbol_t *sa_sym;
       sa_text[sa_ntext++]='\0';
@@ -424,9 +562,5 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
         free(sa_text);
     }
   }
-  if(utf8_cd!=(iconv_t)-1)iconv_close(utf8_cd);
-  if(sjis_cd!=(iconv_t)-1)iconv_close(sjis_cd);
-  if(latin1_cd!=(iconv_t)-1)iconv_close(latin1_cd);
-  free(mark);
   return ntext;
 }
@@ -4,6 +4,7 @@
    Foundation; either version 2.1 of the License, or (at your option) any later
    version.*/
 #include <stdlib.h>
+#include <string.h>
 #include "util.h"
 
 /*Computes floor(sqrt(_val)) exactly.*/
@@ -118,6 +119,72 @@ int qr_ilog(unsigned _v){
 #endif
 }
 
+
+
+/*Allocations are rounded up to this size to keep them all aligned.*/
+#define QR_ARENA_ALIGN (16)
+
+void qr_arena_init(qr_arena *_arena){
+  memset(_arena,0,sizeof(*_arena));
+}
+
+static void qr_arena_free_overflow(qr_arena *_arena){
+  while(_arena->overflow!=NULL){
+    void *next;
+    next=*(void **)_arena->overflow;
+    free(_arena->overflow);
+    _arena->overflow=next;
+  }
+  _arena->noverflow=0;
+}
+
+void qr_arena_clear(qr_arena *_arena){
+  qr_arena_free_overflow(_arena);
+  free(_arena->buf);
+}
+
+void qr_arena_reset(qr_arena *_arena){
+  if(_arena->overflow!=NULL){
+    qr_arena_free_overflow(_arena);
+    /*Nothing in the buffer is live any more, so there is no need to copy.*/
+    free(_arena->buf);
+    _arena->buf=(unsigned char *)malloc(_arena->peak);
+    _arena->size=_arena->buf!=NULL?_arena->peak:0;
+  }
+  _arena->used=0;
+  _arena->peak=0;
+}
+
+void *qr_arena_alloc(qr_arena *_arena,size_t _sz){
+  unsigned char *ret;
+  _sz=_sz+QR_ARENA_ALIGN-1&~(size_t)(QR_ARENA_ALIGN-1);
+  if(_sz<=_arena->size-_arena->used){
+    ret=_arena->buf+_arena->used;
+    _arena->used+=_sz;
+  }
+  else{
+    /*Keep the block on a list to free it at the next reset.
+      The link is padded so that the allocation stays aligned.*/
+    ret=(unsigned char *)malloc(QR_ARENA_ALIGN+_sz);
+    if(ret==NULL)return NULL;
+    *(void **)ret=_arena->overflow;
+    _arena->overflow=ret;
+    _arena->noverflow+=_sz;
+    ret+=QR_ARENA_ALIGN;
+  }
+  if(_arena->peak<_arena->used+_arena->noverflow){
+    _arena->peak=_arena->used+_arena->noverflow;
+  }
+  return ret;
+}
+
+void *qr_arena_calloc(qr_arena *_arena,size_t _n,size_t _sz){
+  void *ret;
+  ret=qr_arena_alloc(_arena,_n*_sz);
+  if(ret!=NULL)memset(ret,0,_n*_sz);
+  return ret;
+}
+
 #if defined(QR_TEST_SQRT)
 #include <math.h>
 #include <stdio.h>
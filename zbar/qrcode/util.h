@@ -5,6 +5,7 @@
    version.*/
 #if !defined(_qrcode_util_H)
 # define _qrcode_util_H (1)
+#include <stddef.h>
 
 #define QR_MAXI(_a,_b)      ((_a)-((_a)-(_b)&-((_b)>(_a))))
 #define QR_MINI(_a,_b)      ((_a)+((_b)-(_a)&-((_b)<(_a))))
@@ -53,4 +54,32 @@ unsigned qr_isqrt(unsigned _val);
 unsigned qr_ihypot(int _x,int _y);
 int qr_ilog(unsigned _val);
 
+
+
+typedef struct qr_arena qr_arena;
+
+/*A scratch allocator for the memory needed while decoding a single image.
+  Allocations are carved out of a single buffer and never freed individually;
+   the whole arena is reset between images instead.
+  Requests that do not fit fall back to malloc(), and the buffer is grown to
+   the high-water mark at the next reset, so once the image size and content
+   settle down, no heap allocation happens at all.*/
+struct qr_arena{
+  unsigned char *buf;
+  size_t         size;
+  size_t         used;
+  /*The list of blocks allocated with malloc() because buf was full.*/
+  void          *overflow;
+  size_t         noverflow;
+  /*The most memory needed at once since the last reset.*/
+  size_t         peak;
+};
+
+void qr_arena_init(qr_arena *_arena);
+void qr_arena_clear(qr_arena *_arena);
+/*Releases all allocations, and grows the buffer if it was too small.*/
+void qr_arena_reset(qr_arena *_arena);
+void *qr_arena_alloc(qr_arena *_arena,size_t _sz);
+void *qr_arena_calloc(qr_arena *_arena,size_t _n,size_t _sz);
+
 #endif
@@ -23,7 +23,8 @@
 
 #include "refcnt.h"
 
-#if !defined(_WIN32) && !defined(TARGET_OS_MAC) && defined(HAVE_LIBPTHREAD)
+#if !defined(_WIN32) && !defined(TARGET_OS_MAC) && \
+    !defined(__ATOMIC_ACQ_REL) && defined(HAVE_LIBPTHREAD)
 
 pthread_once_t initialized = PTHREAD_ONCE_INIT;
 pthread_mutex_t _zbar_reflock;
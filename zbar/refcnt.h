@@ -58,6 +58,22 @@ static inline int _zbar_refcnt (refcnt_t *cnt,
     return(rc);
 }
 
+#elif defined(__ATOMIC_ACQ_REL)
+
+typedef int refcnt_t;
+
+static inline int _zbar_refcnt (refcnt_t *cnt,
+                                int delta)
+{
+    /* taking a reference only needs atomicity; dropping one must also
+     * order prior accesses before whoever frees the object
+     */
+    int rc = __atomic_add_fetch(cnt, delta, (delta > 0) ? __ATOMIC_RELAXED
+                                                        : __ATOMIC_ACQ_REL);
+    assert(rc >= 0);
+    return(rc);
+}
+
 #elif defined(HAVE_LIBPTHREAD)
 # include <pthread.h>
 
@@ -25,6 +25,14 @@
 #include <stdlib.h>     /* malloc, free, abs */
 #include <stddef.h>
 #include <string.h>     /* memset */
+#ifdef HAVE_INTTYPES_H
+# include <inttypes.h>
+#endif
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
 
 #include <zbar.h>
 #include "svg.h"
@@ -60,11 +68,21 @@
 #define EWMA_WEIGHT ((unsigned)((ZBAR_SCANNER_EWMA_WEIGHT              \
                                  * (1 << (ZBAR_FIXED + 1)) + 1) / 2))
 
+/* number of samples filtered per zbar_scanner_scan_line() block */
+#ifndef ZBAR_SCANNER_LINE_BLOCK
+# define ZBAR_SCANNER_LINE_BLOCK 256
+#endif
+
 /* scanner state */
 struct zbar_scanner_s {
     zbar_decoder_t *decoder; /* associated bar width decoder */
     unsigned y1_min_thresh; /* minimum threshold */
 
+    int record;             /* record edges instead of decoding */
+    zbar_edge_t *edges;     /* recorded edge list */
+    unsigned nedges, edges_alloc;
+    unsigned long nlocated; /* edges located (statistics) */
+
     unsigned x;             /* relative scan position of next sample */
     int y0[4];              /* short circular buffer of average intensities */
 
@@ -81,12 +99,18 @@ zbar_scanner_t *zbar_scanner_create (zbar_decoder_t *dcode)
     zbar_scanner_t *scn = malloc(sizeof(zbar_scanner_t));
     scn->decoder = dcode;
     scn->y1_min_thresh = ZBAR_SCANNER_THRESH_MIN;
+    scn->record = 0;
+    scn->edges = NULL;
+    scn->nedges = scn->edges_alloc = 0;
+    scn->nlocated = 0;
     zbar_scanner_reset(scn);
     return(scn);
 }
 
 void zbar_scanner_destroy (zbar_scanner_t *scn)
 {
+    if(scn->edges)
+        free(scn->edges);
     free(scn);
 }
 
@@ -123,6 +147,77 @@ zbar_color_t zbar_scanner_get_color (const zbar_scanner_t *scn)
     return((scn->y1_sign <= 0) ? ZBAR_SPACE : ZBAR_BAR);
 }
 
+void zbar_scanner_record_edges (zbar_scanner_t *scn,
+                                int enable)
+{
+    scn->record = (enable) ? 1 : 0;
+}
+
+const zbar_edge_t *zbar_scanner_get_edges (const zbar_scanner_t *scn,
+                                           unsigned *n)
+{
+    if(n)
+        *n = scn->nedges;
+    return(scn->edges);
+}
+
+void zbar_scanner_clear_edges (zbar_scanner_t *scn)
+{
+    scn->nedges = 0;
+}
+
+/* edges located since the last call, for scan statistics */
+unsigned long _zbar_scanner_take_located (zbar_scanner_t *scn)
+{
+    unsigned long n = scn->nlocated;
+    scn->nlocated = 0;
+    return(n);
+}
+
+/* append an element to the edge list in place of decoding it */
+static inline zbar_symbol_type_t record_edge (zbar_scanner_t *scn,
+                                              unsigned width)
+{
+    zbar_edge_t *edge;
+    if(scn->nedges >= scn->edges_alloc) {
+        scn->edges_alloc = (scn->edges_alloc) ? scn->edges_alloc * 2 : 256;
+        scn->edges = realloc(scn->edges,
+                             scn->edges_alloc * sizeof(zbar_edge_t));
+    }
+    edge = &scn->edges[scn->nedges++];
+    edge->pos = scn->last_edge;
+    edge->width = width;
+    edge->color = zbar_scanner_get_color(scn);
+    return(ZBAR_PARTIAL);
+}
+
+zbar_symbol_type_t zbar_scanner_decode_edges (zbar_scanner_t *scn,
+                                              const zbar_edge_t *edges,
+                                              unsigned n)
+{
+    zbar_symbol_type_t edge = ZBAR_NONE;
+    unsigned last_edge = scn->last_edge, width = scn->width;
+    int y1_sign = scn->y1_sign;
+    if(!scn->decoder)
+        return(ZBAR_NONE);
+
+    for(; n; n--, edges++) {
+        zbar_symbol_type_t tmp;
+        /* callbacks query the recorded element */
+        scn->last_edge = edges->pos;
+        scn->width = edges->width;
+        scn->y1_sign = (edges->color == ZBAR_BAR) ? 1 : -1;
+        tmp = zbar_decode_width(scn->decoder, edges->width);
+        if(tmp < 0 || tmp > edge)
+            edge = tmp;
+    }
+
+    scn->last_edge = last_edge;
+    scn->width = width;
+    scn->y1_sign = y1_sign;
+    return(edge);
+}
+
 static inline unsigned calc_thresh (zbar_scanner_t *scn)
 {
     /* threshold 1st to improve noise rejection */
@@ -163,12 +258,15 @@ static inline zbar_symbol_type_t process_edge (zbar_scanner_t *scn,
              scn->cur_edge & ((1 << ZBAR_FIXED) - 1), scn->width,
              ((y1 > 0) ? "SPACE" : "BAR"));
     scn->last_edge = scn->cur_edge;
+    scn->nlocated++;
 
 #if DEBUG_SVG > 1
     svg_path_moveto(SVG_ABS, scn->last_edge - (1 << ZBAR_FIXED) - ROUND, 0);
 #endif
 
     /* pass to decoder */
+    if(scn->record)
+        return(record_edge(scn, scn->width));
     if(scn->decoder)
         return(zbar_decode_width(scn->decoder, scn->width));
     return(ZBAR_PARTIAL);
@@ -191,6 +289,8 @@ inline zbar_symbol_type_t zbar_scanner_flush (zbar_scanner_t *scn)
     }
 
     scn->y1_sign = scn->width = 0;
+    if(scn->record)
+        return(record_edge(scn, 0));
     if(scn->decoder)
         return(zbar_decode_width(scn->decoder, 0));
     return(ZBAR_PARTIAL);
@@ -208,11 +308,53 @@ zbar_symbol_type_t zbar_scanner_new_scan (zbar_scanner_t *scn)
     /* reset scanner and associated decoder */
     memset(&scn->x, 0, sizeof(zbar_scanner_t) - offsetof(zbar_scanner_t, x));
     scn->y1_thresh = scn->y1_min_thresh;
-    if(scn->decoder)
+    /* recorded scans are separated by the caller */
+    if(scn->decoder && !scn->record)
         zbar_decoder_new_scan(scn->decoder);
     return(edge);
 }
 
+/* locate edge at current sample position (x) from 1st and 2nd
+ * differentials of a confirmed local min/max
+ */
+static inline zbar_symbol_type_t update_edge (zbar_scanner_t *scn,
+                                              int y1_1,
+                                              int y2_1,
+                                              int y2_2)
+{
+    zbar_symbol_type_t edge = ZBAR_NONE;
+
+    /* check for 1st sign change */
+    char y1_rev = (scn->y1_sign > 0) ? y1_1 < 0 : y1_1 > 0;
+    if(y1_rev)
+        /* intensity change reversal - finalize previous edge */
+        edge = process_edge(scn, y1_1);
+
+    if(y1_rev || (abs(scn->y1_sign) < abs(y1_1))) {
+        int d;
+        scn->y1_sign = y1_1;
+
+        /* adaptive thresholding */
+        /* start at multiple of new min/max */
+        scn->y1_thresh = (abs(y1_1) * THRESH_INIT + ROUND) >> ZBAR_FIXED;
+        dbprintf(1, "\tthr=%d", scn->y1_thresh);
+        if(scn->y1_thresh < scn->y1_min_thresh)
+            scn->y1_thresh = scn->y1_min_thresh;
+
+        /* update current edge */
+        d = y2_1 - y2_2;
+        scn->cur_edge = 1 << ZBAR_FIXED;
+        if(!d)
+            scn->cur_edge >>= 1;
+        else if(y2_1)
+            /* interpolate zero crossing */
+            scn->cur_edge -= ((y2_1 << ZBAR_FIXED) + 1) / d;
+        scn->cur_edge += scn->x << ZBAR_FIXED;
+        dbprintf(1, "\n");
+    }
+    return(edge);
+}
+
 zbar_symbol_type_t zbar_scan_y (zbar_scanner_t *scn,
                                 int y)
 {
@@ -253,36 +395,7 @@ zbar_symbol_type_t zbar_scan_y (zbar_scanner_t *scn,
     if((!y2_1 ||
         ((y2_1 > 0) ? y2_2 < 0 : y2_2 > 0)) &&
        (calc_thresh(scn) <= abs(y1_1)))
-    {
-        /* check for 1st sign change */
-        char y1_rev = (scn->y1_sign > 0) ? y1_1 < 0 : y1_1 > 0;
-        if(y1_rev)
-            /* intensity change reversal - finalize previous edge */
-            edge = process_edge(scn, y1_1);
-
-        if(y1_rev || (abs(scn->y1_sign) < abs(y1_1))) {
-            int d;
-            scn->y1_sign = y1_1;
-
-            /* adaptive thresholding */
-            /* start at multiple of new min/max */
-            scn->y1_thresh = (abs(y1_1) * THRESH_INIT + ROUND) >> ZBAR_FIXED;
-            dbprintf(1, "\tthr=%d", scn->y1_thresh);
-            if(scn->y1_thresh < scn->y1_min_thresh)
-                scn->y1_thresh = scn->y1_min_thresh;
-
-            /* update current edge */
-            d = y2_1 - y2_2;
-            scn->cur_edge = 1 << ZBAR_FIXED;
-            if(!d)
-                scn->cur_edge >>= 1;
-            else if(y2_1)
-                /* interpolate zero crossing */
-                scn->cur_edge -= ((y2_1 << ZBAR_FIXED) + 1) / d;
-            scn->cur_edge += x << ZBAR_FIXED;
-            dbprintf(1, "\n");
-        }
-    }
+        edge = update_edge(scn, y1_1, y2_1, y2_2);
     else
         dbprintf(1, "\n");
     /* FIXME add fall-thru pass to decoder after heuristic "idle" period
@@ -291,6 +404,220 @@ zbar_symbol_type_t zbar_scan_y (zbar_scanner_t *scn,
     return(edge);
 }
 
+/* flag samples that could start an edge (2nd differential zero-crossing
+ * with 1st differential above the minimum threshold).  the state dependent
+ * threshold check is left to scan_candidate(), which is only called
+ * for flagged samples.
+ *   y0 points at filtered sample x, with 3 samples of valid history
+ *   returns bitmask of candidates in samples x..x+7
+ */
+#if defined(__SSE2__)
+
+static inline unsigned scan_flags8 (const int16_t *y0,
+                                    int thresh)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i y0_0 = _mm_loadu_si128((const __m128i*)y0);
+    __m128i y0_1 = _mm_loadu_si128((const __m128i*)(y0 - 1));
+    __m128i y0_2 = _mm_loadu_si128((const __m128i*)(y0 - 2));
+    __m128i y0_3 = _mm_loadu_si128((const __m128i*)(y0 - 3));
+    __m128i y1_1 = _mm_sub_epi16(y0_1, y0_2);
+    __m128i y1_2 = _mm_sub_epi16(y0_2, y0_3);
+    __m128i a1_1 = _mm_max_epi16(y1_1, _mm_sub_epi16(zero, y1_1));
+    __m128i a1_2 = _mm_max_epi16(y1_2, _mm_sub_epi16(zero, y1_2));
+    /* same slope direction => take steeper of the two */
+    __m128i same = _mm_cmpgt_epi16(_mm_xor_si128(y1_1, y1_2),
+                                   _mm_set1_epi16(-1));
+    __m128i a1 = _mm_or_si128(_mm_and_si128(same, _mm_max_epi16(a1_1, a1_2)),
+                              _mm_andnot_si128(same, a1_1));
+    __m128i y2_1 = _mm_add_epi16(_mm_sub_epi16(y0_0, _mm_add_epi16(y0_1, y0_1)),
+                                 y0_2);
+    __m128i y2_2 = _mm_add_epi16(_mm_sub_epi16(y0_1, _mm_add_epi16(y0_2, y0_2)),
+                                 y0_3);
+    __m128i zc = _mm_or_si128(
+        _mm_cmpeq_epi16(y2_1, zero),
+        _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi16(y2_1, zero),
+                                   _mm_cmplt_epi16(y2_2, zero)),
+                     _mm_and_si128(_mm_cmplt_epi16(y2_1, zero),
+                                   _mm_cmpgt_epi16(y2_2, zero))));
+    __m128i m = _mm_and_si128(zc, _mm_cmpgt_epi16(a1,
+                                                  _mm_set1_epi16(thresh - 1)));
+    return(_mm_movemask_epi8(_mm_packs_epi16(m, zero)) & 0xff);
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+static inline unsigned scan_flags8 (const int16_t *y0,
+                                    int thresh)
+{
+    static const uint16_t bits[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    int16x8_t zero = vdupq_n_s16(0);
+    int16x8_t y0_0 = vld1q_s16(y0);
+    int16x8_t y0_1 = vld1q_s16(y0 - 1);
+    int16x8_t y0_2 = vld1q_s16(y0 - 2);
+    int16x8_t y0_3 = vld1q_s16(y0 - 3);
+    int16x8_t y1_1 = vsubq_s16(y0_1, y0_2);
+    int16x8_t y1_2 = vsubq_s16(y0_2, y0_3);
+    int16x8_t a1_1 = vabsq_s16(y1_1);
+    /* same slope direction => take steeper of the two */
+    uint16x8_t same = vcgeq_s16(veorq_s16(y1_1, y1_2), zero);
+    int16x8_t a1 = vbslq_s16(same, vmaxq_s16(a1_1, vabsq_s16(y1_2)), a1_1);
+    int16x8_t y2_1 = vaddq_s16(vsubq_s16(y0_0, vaddq_s16(y0_1, y0_1)), y0_2);
+    int16x8_t y2_2 = vaddq_s16(vsubq_s16(y0_1, vaddq_s16(y0_2, y0_2)), y0_3);
+    uint16x8_t zc = vorrq_u16(
+        vceqq_s16(y2_1, zero),
+        vorrq_u16(vandq_u16(vcgtq_s16(y2_1, zero), vcltq_s16(y2_2, zero)),
+                  vandq_u16(vcltq_s16(y2_1, zero), vcgtq_s16(y2_2, zero))));
+    uint16x8_t m = vandq_u16(zc, vcgeq_s16(a1, vdupq_n_s16(thresh)));
+    uint16x4_t s;
+    m = vandq_u16(m, vld1q_u16(bits));
+    s = vadd_u16(vget_low_u16(m), vget_high_u16(m));
+    s = vpadd_u16(s, s);
+    s = vpadd_u16(s, s);
+    return(vget_lane_u16(s, 0));
+}
+
+#else
+
+static inline unsigned scan_flags8 (const int16_t *y0,
+                                    int thresh)
+{
+    unsigned flags = 0;
+    int i;
+    for(i = 7; i >= 0; i--) {
+        const int16_t *y = y0 + i;
+        int y1_1 = y[-1] - y[-2], y1_2 = y[-2] - y[-3];
+        int y2_1 = y[0] - (y[-1] * 2) + y[-2];
+        int y2_2 = y[-1] - (y[-2] * 2) + y[-3];
+        int a1 = abs(y1_1);
+        if((y1_1 >= 0) == (y1_2 >= 0) && a1 < abs(y1_2))
+            a1 = abs(y1_2);
+        flags <<= 1;
+        if((!y2_1 || ((y2_1 > 0) ? y2_2 < 0 : y2_2 > 0)) && a1 >= thresh)
+            flags |= 1;
+    }
+    return(flags);
+}
+
+#endif
+
+/* complete zbar_scan_y() processing of a flagged sample
+ *   y0 points at filtered sample x, with 3 samples of valid history
+ */
+static inline zbar_symbol_type_t scan_candidate (zbar_scanner_t *scn,
+                                                 const int16_t *y0,
+                                                 unsigned x)
+{
+    int y1_1 = y0[-1] - y0[-2];
+    int y1_2 = y0[-2] - y0[-3];
+    int y2_1 = y0[0] - (y0[-1] * 2) + y0[-2];
+    int y2_2 = y0[-1] - (y0[-2] * 2) + y0[-3];
+    if((abs(y1_1) < abs(y1_2)) &&
+       ((y1_1 >= 0) == (y1_2 >= 0)))
+        y1_1 = y1_2;
+
+    /* callbacks (and threshold decay) see the current position */
+    scn->x = x;
+    if(calc_thresh(scn) > abs(y1_1))
+        return(ZBAR_NONE);
+    return(update_edge(scn, y1_1, y2_1, y2_2));
+}
+
+/* vectorized filter is only equivalent to zbar_scan_y() once the
+ * history is known to be 8-bit samples and any flushed edge has been
+ * passed
+ */
+static inline int scan_line_ready (const zbar_scanner_t *scn)
+{
+    int i;
+    if(!scn->x)
+        return(1);
+    if(scn->width && (scn->x << ZBAR_FIXED) < scn->last_edge)
+        return(0);
+    for(i = 0; i < 4; i++)
+        if(scn->y0[i] < 0 || scn->y0[i] > 0xff)
+            return(0);
+    return(1);
+}
+
+zbar_symbol_type_t zbar_scanner_scan_line (zbar_scanner_t *scn,
+                                           const unsigned char *p,
+                                           int n,
+                                           int stride)
+{
+    int16_t y0[ZBAR_SCANNER_LINE_BLOCK + 3];
+    zbar_symbol_type_t edge = ZBAR_NONE;
+    int thresh = (scn->y1_min_thresh < 0x7fff) ? scn->y1_min_thresh : 0x7fff;
+    unsigned x;
+
+#ifndef DEBUG_SCANNER
+    while(n > 0 && !scan_line_ready(scn))
+#else
+    /* sample-by-sample for debug spew */
+    while(n > 0)
+#endif
+    {
+        zbar_symbol_type_t tmp = zbar_scan_y(scn, *p);
+        if(tmp < 0 || tmp > edge)
+            edge = tmp;
+        p += stride;
+        n--;
+    }
+    if(n <= 0)
+        return(edge);
+
+    /* seed filter history */
+    x = scn->x;
+    if(!x)
+        y0[0] = y0[1] = y0[2] = *p;
+    else {
+        y0[0] = scn->y0[(x - 3) & 3];
+        y0[1] = scn->y0[(x - 2) & 3];
+        y0[2] = scn->y0[(x - 1) & 3];
+    }
+
+    while(n > 0) {
+        int i, m = (n < ZBAR_SCANNER_LINE_BLOCK) ? n : ZBAR_SCANNER_LINE_BLOCK;
+
+        /* weighted moving average is a recurrence - no help from SIMD */
+        int y = y0[2];
+        for(i = 0; i < m; i++, p += stride) {
+            y += ((int)((*p - y) * EWMA_WEIGHT)) >> ZBAR_FIXED;
+            y0[i + 3] = y;
+        }
+        /* pad partial vector (extra flags are masked below) */
+        for(; i & 7; i++)
+            y0[i + 3] = y;
+
+        for(i = 0; i < m; i += 8) {
+            unsigned flags = scan_flags8(y0 + i + 3, thresh);
+            int j;
+            if(m - i < 8)
+                flags &= (1 << (m - i)) - 1;
+            for(j = 0; flags; j++, flags >>= 1)
+                if(flags & 1) {
+                    zbar_symbol_type_t tmp =
+                        scan_candidate(scn, y0 + i + j + 3, x + i + j);
+                    if(tmp < 0 || tmp > edge)
+                        edge = tmp;
+                }
+        }
+
+        x += m;
+        n -= m;
+        y0[0] = y0[m];
+        y0[1] = y0[m + 1];
+        y0[2] = y0[m + 2];
+    }
+
+    /* leave state as zbar_scan_y() would */
+    scn->x = x;
+    scn->y0[(x - 1) & 3] = y0[2];
+    scn->y0[(x - 2) & 3] = y0[1];
+    scn->y0[(x - 3) & 3] = y0[0];
+    return(edge);
+}
+
 /* undocumented API for drawing cutesy debug graphics */
 void zbar_scanner_get_state (const zbar_scanner_t *scn,
                              unsigned *x,
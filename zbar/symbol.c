@@ -69,9 +69,16 @@ const char *zbar_get_config_name (zbar_config_t cfg)
     case ZBAR_CFG_MIN_LEN: return("MIN_LEN");
     case ZBAR_CFG_MAX_LEN: return("MAX_LEN");
     case ZBAR_CFG_UNCERTAINTY: return("UNCERTAINTY");
+    case ZBAR_CFG_STOP_AFTER: return("STOP_AFTER");
     case ZBAR_CFG_POSITION: return("POSITION");
+    case ZBAR_CFG_EDGE_LIST: return("EDGE_LIST");
     case ZBAR_CFG_X_DENSITY: return("X_DENSITY");
     case ZBAR_CFG_Y_DENSITY: return("Y_DENSITY");
+    case ZBAR_CFG_COARSE_DENSITY: return("COARSE_DENSITY");
+    case ZBAR_CFG_TRACK_INTERVAL: return("TRACK_INTERVAL");
+    case ZBAR_CFG_SKIP_THRESHOLD: return("SKIP_THRESHOLD");
+    case ZBAR_CFG_SKIP_INTERVAL: return("SKIP_INTERVAL");
+    case ZBAR_CFG_MAX_RESULTS: return("MAX_RESULTS");
     default: return("");
     }
 }
@@ -118,9 +125,9 @@ void _zbar_symbol_free (zbar_symbol_t *sym)
         zbar_symbol_set_ref(sym->syms, -1);
         sym->syms = NULL;
     }
-    if(sym->pts)
+    if(sym->pts != sym->inline_pts)
         free(sym->pts);
-    if(sym->data_alloc && sym->data)
+    if(sym->data_alloc && sym->data != SYM_INLINE_DATA(sym))
         free(sym->data);
     free(sym);
 }
@@ -190,6 +197,57 @@ int zbar_symbol_get_loc_y (const zbar_symbol_t *sym,
         return(-1);
 }
 
+/* merge a point into the location outline of a symbol.  the outline is
+ * the octagon bounded by the support line of the merged points in each
+ * of 8 directions (45 degrees apart, clockwise from +x).  it contains
+ * every point merged so far, and its vertices (where adjacent support
+ * lines cross) are integral since each pair is one axis and one diagonal
+ */
+void _zbar_symbol_outline (zbar_symbol_t *sym,
+                           int x,
+                           int y)
+{
+    /* projection of each direction onto (x, y) */
+    static const signed char dir[SYM_OUTLINE_MAX][2] = {
+        {  1,  0 }, {  1,  1 }, {  0,  1 }, { -1,  1 },
+        { -1,  0 }, { -1, -1 }, {  0, -1 }, {  1, -1 },
+    };
+    point_t outline[SYM_OUTLINE_MAX];
+    int max[SYM_OUTLINE_MAX];
+    unsigned n = 0, i, d;
+
+    /* the outline vertices have the same support as the points */
+    assert(sym->npts <= SYM_OUTLINE_MAX);
+    for(d = 0; d < SYM_OUTLINE_MAX; d++) {
+        max[d] = dir[d][0] * x + dir[d][1] * y;
+        for(i = 0; i < sym->npts; i++) {
+            int v = dir[d][0] * sym->pts[i].x + dir[d][1] * sym->pts[i].y;
+            if(max[d] < v)
+                max[d] = v;
+        }
+    }
+
+    /* vertex between support lines d and d + 1 */
+    for(d = 0; d < SYM_OUTLINE_MAX; d++) {
+        const signed char *u = dir[d], *v = dir[(d + 1) % SYM_OUTLINE_MAX];
+        int su = max[d], sv = max[(d + 1) % SYM_OUTLINE_MAX];
+        int det = u[0] * v[1] - u[1] * v[0];
+        point_t p;
+        assert(det == 1 || det == -1);
+        p.x = (su * v[1] - sv * u[1]) * det;
+        p.y = (sv * u[0] - su * v[0]) * det;
+        if(!n || outline[n - 1].x != p.x || outline[n - 1].y != p.y)
+            outline[n++] = p;
+    }
+    while(n > 1 &&
+          outline[n - 1].x == outline[0].x && outline[n - 1].y == outline[0].y)
+        n--;
+
+    sym->npts = 0;
+    for(i = 0; i < n; i++)
+        sym_add_point(sym, outline[i].x, outline[i].y);
+}
+
 zbar_orientation_t zbar_symbol_get_orientation (const zbar_symbol_t *sym)
 {
     return(sym->orient);
@@ -396,6 +454,11 @@ int zbar_symbol_set_get_size (const zbar_symbol_set_t *syms)
     return(syms->nsyms);
 }
 
+int zbar_symbol_set_is_truncated (const zbar_symbol_set_t *syms)
+{
+    return(syms->truncated);
+}
+
 const zbar_symbol_t*
 zbar_symbol_set_first_symbol (const zbar_symbol_set_t *syms)
 {
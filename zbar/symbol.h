@@ -24,11 +24,15 @@
 #define _SYMBOL_H_
 
 #include <stdlib.h>
+#include <string.h>
 #include <zbar.h>
 #include "refcnt.h"
 
 #define NUM_SYMS  20
 
+/* maximum number of points in an outline (see _zbar_symbol_outline) */
+#define SYM_OUTLINE_MAX 8
+
 typedef struct point_s {
     int x, y;
 } point_t;
@@ -38,6 +42,7 @@ struct zbar_symbol_set_s {
     int nsyms;                  /* number of filtered symbols */
     zbar_symbol_t *head;        /* first of decoded symbol results */
     zbar_symbol_t *tail;        /* last of unfiltered symbol results */
+    int truncated;              /* scan stopped at deadline */
 };
 
 struct zbar_symbol_s {
@@ -59,8 +64,14 @@ struct zbar_symbol_s {
     unsigned long time;         /* relative symbol capture time */
     int cache_count;            /* cache state */
     int quality;                /* relative symbol reliability metric */
+
+    unsigned inline_alloc;      /* size of data storage following symbol */
+    point_t inline_pts[SYM_OUTLINE_MAX]; /* initial location polygon storage */
 };
 
+/* data storage allocated in the same block as a symbol */
+#define SYM_INLINE_DATA(sym) ((char*)((sym) + 1))
+
 extern int _zbar_get_symbol_hash(zbar_symbol_type_t);
 
 extern void _zbar_symbol_free(zbar_symbol_t*);
@@ -68,13 +79,22 @@ extern void _zbar_symbol_free(zbar_symbol_t*);
 extern zbar_symbol_set_t *_zbar_symbol_set_create(void);
 extern void _zbar_symbol_set_free(zbar_symbol_set_t*);
 
+extern void _zbar_symbol_outline(zbar_symbol_t*, int, int);
+
 static inline void sym_add_point (zbar_symbol_t *sym,
                                   int x,
                                   int y)
 {
     int i = sym->npts;
-    if(++sym->npts >= sym->pts_alloc)
-        sym->pts = realloc(sym->pts, ++sym->pts_alloc * sizeof(point_t));
+    if(++sym->npts > sym->pts_alloc) {
+        /* outgrew inline storage (outlines never do) */
+        point_t *pts = malloc(sym->pts_alloc * 2 * sizeof(point_t));
+        memcpy(pts, sym->pts, i * sizeof(point_t));
+        if(sym->pts != sym->inline_pts)
+            free(sym->pts);
+        sym->pts = pts;
+        sym->pts_alloc *= 2;
+    }
     sym->pts[i].x = x;
     sym->pts[i].y = y;
 }
@@ -37,6 +37,8 @@
  *     returns timer or NULL if timeout < 0 (no/infinite timeout)
  * _zbar_timer_check() returns ms remaining until expiration.
  *     will be <= 0 if timer has expired
+ * _zbar_timer_now_us() returns a us timestamp for measuring intervals
+ *     (wraps, only differences are meaningful)
  */
 
 #if _POSIX_TIMERS > 0
@@ -76,6 +78,31 @@ static inline int _zbar_timer_check (zbar_timer_t *timer)
     return((delay >= 0) ? delay : 0);
 }
 
+static inline unsigned long _zbar_timer_now_us ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return(now.tv_sec * 1000000UL + now.tv_nsec / 1000);
+}
+
+static inline zbar_timer_t *_zbar_timer_init_us (zbar_timer_t *timer,
+                                                 unsigned long delay)
+{
+    clock_gettime(CLOCK_REALTIME, timer);
+    timer->tv_nsec += (delay % 1000000) * 1000;
+    timer->tv_sec += (delay / 1000000) + (timer->tv_nsec / 1000000000);
+    timer->tv_nsec %= 1000000000;
+    return(timer);
+}
+
+static inline int _zbar_timer_expired (const zbar_timer_t *timer)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return(now.tv_sec > timer->tv_sec ||
+           (now.tv_sec == timer->tv_sec && now.tv_nsec >= timer->tv_nsec));
+}
+
 
 #elif defined(_WIN32)
 
@@ -108,6 +135,23 @@ static inline int _zbar_timer_check (zbar_timer_t *timer)
     return((delay >= 0) ? delay : 0);
 }
 
+static inline unsigned long _zbar_timer_now_us ()
+{
+    return(timeGetTime() * 1000UL);
+}
+
+static inline zbar_timer_t *_zbar_timer_init_us (zbar_timer_t *timer,
+                                                 unsigned long delay)
+{
+    *timer = timeGetTime() + (delay + 999) / 1000;
+    return(timer);
+}
+
+static inline int _zbar_timer_expired (const zbar_timer_t *timer)
+{
+    return((int)(*timer - timeGetTime()) <= 0);
+}
+
 
 #elif defined(HAVE_SYS_TIME_H)
 
@@ -144,6 +188,31 @@ static inline int _zbar_timer_check (zbar_timer_t *timer)
            (timer->tv_usec - now.tv_usec) / 1000);
 }
 
+static inline unsigned long _zbar_timer_now_us ()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return(now.tv_sec * 1000000UL + now.tv_usec);
+}
+
+static inline zbar_timer_t *_zbar_timer_init_us (zbar_timer_t *timer,
+                                                 unsigned long delay)
+{
+    gettimeofday(timer, NULL);
+    timer->tv_usec += delay % 1000000;
+    timer->tv_sec += (delay / 1000000) + (timer->tv_usec / 1000000);
+    timer->tv_usec %= 1000000;
+    return(timer);
+}
+
+static inline int _zbar_timer_expired (const zbar_timer_t *timer)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return(now.tv_sec > timer->tv_sec ||
+           (now.tv_sec == timer->tv_sec && now.tv_usec >= timer->tv_usec));
+}
+
 #else
 # error "unable to find a timer interface"
 #endif
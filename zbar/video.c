@@ -245,6 +245,7 @@ static inline int video_init_images (zbar_video_t *vdo)
         zbar_image_t *img = vdo->images[i];
         img->format = vdo->format;
         zbar_image_set_size(img, vdo->width, vdo->height);
+        img->stride = vdo->stride;
         if(vdo->iomode != VIDEO_MMAP) {
             unsigned long offset = i * vdo->datalen;
             img->datalen = vdo->datalen;
@@ -368,6 +369,7 @@ zbar_image_t *zbar_video_next_image (zbar_video_t *vdo)
 
                 img->format = vdo->format;
                 zbar_image_set_size(img, vdo->width, vdo->height);
+                img->stride = vdo->stride;
                 img->datalen = vdo->datalen;
                 img->data = malloc(vdo->datalen);
             }
@@ -71,6 +71,7 @@ struct zbar_video_s {
     uint32_t *formats;          /* 0 terminated list of supported formats */
 
     unsigned long datalen;      /* size of image data for selected format */
+    unsigned stride;            /* bytes between rows (0 = packed) */
     unsigned long buflen;       /* total size of image data buffer */
     void *buf;                  /* image data buffer */
 
@@ -294,6 +294,7 @@ static int v4l2_set_format (zbar_video_t *vdo,
     vdo->width = newpix->width;
     vdo->height = newpix->height;
     vdo->datalen = newpix->sizeimage;
+    vdo->stride = newpix->bytesperline;
 
     zprintf(1, "set new format: %.4s(%08x) %u x %u (0x%lx)\n",
             (char*)&vdo->format, vdo->format, vdo->width, vdo->height,
@@ -380,6 +381,7 @@ static inline int v4l2_probe_formats (zbar_video_t *vdo)
 
     vdo->format = pix->pixelformat;
     vdo->datalen = pix->sizeimage;
+    vdo->stride = pix->bytesperline;
     if(pix->width == vdo->width && pix->height == vdo->height)
         return(0);
 
@@ -411,6 +413,7 @@ static inline int v4l2_probe_formats (zbar_video_t *vdo)
     vdo->width = pix->width;
     vdo->height = pix->height;
     vdo->datalen = pix->sizeimage;
+    vdo->stride = pix->bytesperline;
     return(0);
 }
 